@@ -0,0 +1,199 @@
+//协程版的生产者消费者队列：co_await queue.Pop() 挂起协程而不是阻塞线程，需要 C++20
+
+#ifndef _MARK_ASYNC_PC_QUEUE_H
+#define _MARK_ASYNC_PC_QUEUE_H
+
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "AsyncProducerConsumerQueue.h requires C++20 coroutines (-std=c++20)"
+#endif
+
+#include <coroutine>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <type_traits>
+#include <utility>
+
+#include "QueueStats.h"
+
+//在调用 Push/Cancel 的线程上直接恢复协程（在锁外）
+struct InlineExecutor
+{
+    void Post(std::coroutine_handle<> handle) { handle.resume(); }
+};
+
+//接口和 ProducerConsumerQueue 保持一致，区别在于没有元素时等待的是协程：
+//  co_await queue.Pop() 的结果是 std::optional<T>，队列被 Cancel 后返回 std::nullopt 表示流结束；
+//  Push 时如果有协程在等，元素直接交给排在最前面的那一个，并把它交给执行器恢复，每次只恢复一个；
+//  等待者是协程帧里的 awaiter 对象本身，通过侵入式链表排队，等待过程中没有堆分配。
+//Executor 需要提供 void Post(std::coroutine_handle<>)，由它决定协程在哪个线程上恢复；
+//Post 总是在锁外调用。执行器的生命周期需要长于队列。
+template <typename T, typename Executor = InlineExecutor>
+class AsyncProducerConsumerQueue{
+public:
+    class PopAwaiter;
+
+    AsyncProducerConsumerQueue() : _executor(&DefaultExecutor()), _waitHead(nullptr), _waitTail(nullptr), _shutdown(false){}
+    explicit AsyncProducerConsumerQueue(Executor& executor)
+        : _executor(&executor), _waitHead(nullptr), _waitTail(nullptr), _shutdown(false){}
+
+    void Push(const T& value){ Emplace(value); }
+    void Push(T&& value){ Emplace(std::move(value)); }
+
+    template<typename... Args>
+    void Emplace(Args&&... args){
+        PopAwaiter* waiter;
+        {
+            std::lock_guard<std::mutex> lock(_queueLock);
+            _stats.OnEnqueue();
+            waiter = _waitHead;
+            if (!waiter)
+            {
+                _queue.emplace(std::forward<Args>(args)...);
+                _stats.OnDepth(_queue.size());
+                return;
+            }
+
+            //直接交给等待者，不经过队列
+            _waitHead = waiter->_next;
+            if (!_waitHead)
+                _waitTail = nullptr;
+            waiter->_result.emplace(std::forward<Args>(args)...);
+            _stats.OnDequeue();
+        }
+
+        _executor->Post(waiter->_handle);
+    }
+
+    //不等待，队列为空或已取消时返回 false
+    bool TryPop(T& value){
+        std::lock_guard<std::mutex> lock(_queueLock);
+
+        if (_queue.empty() || _shutdown)
+        {
+            _stats.OnEmptyPoll();
+            return false;
+        }
+
+        value = std::move(_queue.front());
+        _queue.pop();
+        _stats.OnDequeue();
+        return true;
+    }
+
+    //co_await queue.Pop()
+    PopAwaiter Pop(){ return PopAwaiter(*this); }
+
+    bool Empty(){
+        std::lock_guard<std::mutex> lock(_queueLock);
+        return _queue.empty();
+    }
+
+    //取消队列：丢弃剩余元素（指针类型会被 delete），所有正在等待的协程以 std::nullopt 恢复
+    void Cancel(){
+        PopAwaiter* waiter;
+        {
+            std::lock_guard<std::mutex> lock(_queueLock);
+            //丢弃的元素按出队计
+            _stats.OnDequeue(_queue.size());
+            while (!_queue.empty())
+            {
+                DeleteQueuedObject(_queue.front());
+                _queue.pop();
+            }
+
+            _shutdown = true;
+            waiter = _waitHead;
+            _waitHead = nullptr;
+            _waitTail = nullptr;
+        }
+
+        while (waiter)
+        {
+            //恢复之后 awaiter 可能随协程帧一起销毁，先取出下一个
+            PopAwaiter* next = waiter->_next;
+            _executor->Post(waiter->_handle);
+            waiter = next;
+        }
+    }
+
+    bool Cancelled(){
+        std::lock_guard<std::mutex> lock(_queueLock);
+        return _shutdown;
+    }
+
+    //统计快照，未定义 MARK_QUEUE_STATS 时全为 0
+    QueueStatsSnapshot Stats() const
+    {
+        return _stats.Snapshot();
+    }
+
+    class PopAwaiter{
+    public:
+        explicit PopAwaiter(AsyncProducerConsumerQueue& queue) : _queue(queue), _next(nullptr){}
+
+        PopAwaiter(PopAwaiter const&) = delete;
+        PopAwaiter& operator=(PopAwaiter const&) = delete;
+
+        //总是进入 await_suspend，在锁内决定是否真的挂起
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle){
+            std::lock_guard<std::mutex> lock(_queue._queueLock);
+            if (_queue._shutdown)
+                return false;
+
+            if (!_queue._queue.empty())
+            {
+                _result.emplace(std::move(_queue._queue.front()));
+                _queue._queue.pop();
+                _queue._stats.OnDequeue();
+                return false;
+            }
+
+            _handle = handle;
+            if (_queue._waitTail)
+                _queue._waitTail->_next = this;
+            else
+                _queue._waitHead = this;
+            _queue._waitTail = this;
+            _queue._stats.OnBlockedWait();
+            return true;
+        }
+
+        std::optional<T> await_resume(){ return std::move(_result); }
+
+    private:
+        friend class AsyncProducerConsumerQueue;
+
+        AsyncProducerConsumerQueue& _queue;
+        PopAwaiter* _next;               //等待链表中的下一个
+        std::coroutine_handle<> _handle;
+        std::optional<T> _result;        //Push 交过来的元素，取消时为空
+    };
+
+private:
+    static Executor& DefaultExecutor(){
+        static Executor executor;
+        return executor;
+    }
+
+    template<typename E = T>
+    typename std::enable_if<std::is_pointer<E>::value>::type DeleteQueuedObject(E& obj) { delete obj; }
+
+    template<typename E = T>
+    typename std::enable_if<!std::is_pointer<E>::value>::type DeleteQueuedObject(E const& /*packet*/) { }
+
+    std::mutex _queueLock;
+    std::queue<T> _queue;
+    Executor* _executor;
+    PopAwaiter* _waitHead;   //等待的协程，先进先出
+    PopAwaiter* _waitTail;
+    bool _shutdown;          //由 _queueLock 保护
+    QueueStats _stats;       //运行统计，只有定义 MARK_QUEUE_STATS 时才有开销
+
+    AsyncProducerConsumerQueue(AsyncProducerConsumerQueue const&) = delete;
+    AsyncProducerConsumerQueue& operator=(AsyncProducerConsumerQueue const&) = delete;
+};
+
+#endif
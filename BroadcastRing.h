@@ -0,0 +1,251 @@
+// 广播环形队列（disruptor 风格）：每条消息只写一次，所有消费者在原地读取同一份
+
+#ifndef _MARK_BROADCAST_RING_H
+#define _MARK_BROADCAST_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CacheLine.h"
+#include "Futex.h"
+
+enum class BroadcastProducer
+{
+    Single, // 只有一个生产者线程
+    Multi   // 多个生产者线程，用 CAS 领取序号
+};
+
+// 槽位在构造时一次性创建（T 需要可默认构造），之后生产者原地写、消费者原地读，不再有分配和拷贝。
+// 每条消息有一个从 0 开始递增的序号，落在 seq & mask 号槽位上：
+//   生产者：Claim 领取序号，写 ring[seq]，Publish 发布；所有消费者都处理完 seq - capacity 之前不会覆盖；
+//   消费者：每个消费者有自己的游标（已处理到的序号），Poll 一次取出所有已发布的消息批量处理，最后才推进游标；
+//   依赖：AddConsumer 时可以指定依赖的消费者，只有它们都处理过的消息才对这个消费者可见。
+// 单生产者发布时只写一个游标；多生产者的发布可能乱序，每个槽位记录最近一次发布的序号，
+// 消费者从自己的位置向前扫描连续发布的一段。
+// 等待用自旋加让出 CPU，适合消费者各自独占核的场景。
+// 所有消费者都要在开始发布之前注册。
+template<typename T, BroadcastProducer Producer = BroadcastProducer::Single>
+class BroadcastRing
+{
+public:
+    static constexpr int SpinCount = 64; // 等待时先自旋多少次再让出 CPU
+
+    class Consumer
+    {
+    public:
+        // 已经处理到的序号，依赖它的消费者和生产者读取
+        int64_t Sequence() const { return _sequence.load(std::memory_order_acquire); }
+
+    private:
+        friend class BroadcastRing;
+
+        Consumer() : _sequence(-1), _cachedAvailable(-1) {}
+
+        alignas(CacheLineSize) std::atomic<int64_t> _sequence;
+        int64_t _cachedAvailable; // 上次看到的可读上限，只由本消费者访问
+        std::vector<const Consumer*> _dependsOn;
+    };
+
+    // capacity 会向上取整到 2 的幂
+    explicit BroadcastRing(size_t capacity)
+        : _capacity(RoundUp(capacity)), _mask(_capacity - 1), _slots(new T[_capacity]),
+        _published(Producer == BroadcastProducer::Multi ? new std::atomic<int64_t>[_capacity] : nullptr),
+        _next(0), _cachedGate(-1), _cursor(-1)
+    {
+        if (_published)
+            for (size_t i = 0; i < _capacity; ++i)
+                _published[i].store(-1, std::memory_order_relaxed);
+    }
+
+    // 注册一个消费者，dependsOn 中的消费者处理过的消息它才能看到
+    Consumer* AddConsumer(std::initializer_list<const Consumer*> dependsOn = {})
+    {
+        _consumers.emplace_back(new Consumer());
+        Consumer* consumer = _consumers.back().get();
+        consumer->_dependsOn.assign(dependsOn.begin(), dependsOn.end());
+        return consumer;
+    }
+
+    // 领取 n 个连续序号，返回第一个；环满时等待最慢的消费者
+    int64_t Claim(size_t n = 1)
+    {
+        int64_t first;
+        for (int spin = 0; !TryClaim(first, n); ++spin)
+            Pause(spin);
+        return first;
+    }
+
+    // 不等待的领取，环满时返回 false
+    bool TryClaim(int64_t& first, size_t n = 1)
+    {
+        if (Producer == BroadcastProducer::Single)
+        {
+            int64_t next = _next.load(std::memory_order_relaxed);
+            if (!HasRoom(next, n))
+                return false;
+            _next.store(next + n, std::memory_order_relaxed);
+            first = next;
+            return true;
+        }
+
+        int64_t next = _next.load(std::memory_order_relaxed);
+        do
+        {
+            if (!HasRoom(next, n))
+                return false;
+        } while (!_next.compare_exchange_weak(next, next + n, std::memory_order_relaxed, std::memory_order_relaxed));
+        first = next;
+        return true;
+    }
+
+    // 领取到的序号对应的槽位，发布之前只有领取者可以写
+    T& operator[](int64_t seq) { return _slots[seq & _mask]; }
+    const T& operator[](int64_t seq) const { return _slots[seq & _mask]; }
+
+    // 发布 [first, first + n)，之后消费者可以读取
+    void Publish(int64_t first, size_t n = 1)
+    {
+        int64_t last = first + static_cast<int64_t>(n) - 1;
+        if (Producer == BroadcastProducer::Single)
+        {
+            _cursor.store(last, std::memory_order_release);
+            return;
+        }
+
+        for (int64_t seq = first; seq <= last; ++seq)
+            _published[seq & _mask].store(seq, std::memory_order_release);
+    }
+
+    // 领取、写入、发布一条消息
+    template<typename U>
+    void Enqueue(U&& value)
+    {
+        int64_t seq = Claim();
+        (*this)[seq] = std::forward<U>(value);
+        Publish(seq);
+    }
+
+    // 处理 consumer 可见的所有消息（最多 maxBatch 条），handler(const T&, seq, endOfBatch)，
+    // 整批处理完才推进游标，返回处理的条数，没有新消息时返回 0
+    template<typename Handler>
+    size_t Poll(Consumer* consumer, Handler&& handler, size_t maxBatch = std::numeric_limits<size_t>::max())
+    {
+        int64_t next = consumer->_sequence.load(std::memory_order_relaxed) + 1;
+        if (consumer->_cachedAvailable < next)
+        {
+            consumer->_cachedAvailable = Available(consumer, next);
+            if (consumer->_cachedAvailable < next)
+                return 0;
+        }
+
+        int64_t last = consumer->_cachedAvailable;
+        if (static_cast<uint64_t>(last - next) >= maxBatch)
+            last = next + static_cast<int64_t>(maxBatch) - 1;
+
+        for (int64_t seq = next; seq <= last; ++seq)
+            handler(static_cast<const T&>(_slots[seq & _mask]), seq, seq == last);
+
+        consumer->_sequence.store(last, std::memory_order_release);
+        return static_cast<size_t>(last - next + 1);
+    }
+
+    // 等到至少有一条消息可见再处理
+    template<typename Handler>
+    size_t PollWait(Consumer* consumer, Handler&& handler, size_t maxBatch = std::numeric_limits<size_t>::max())
+    {
+        for (int spin = 0;; ++spin)
+        {
+            size_t count = Poll(consumer, handler, maxBatch);
+            if (count)
+                return count;
+            Pause(spin);
+        }
+    }
+
+    size_t Capacity() const { return _capacity; }
+
+private:
+    static size_t RoundUp(size_t n)
+    {
+        size_t capacity = 1;
+        while (capacity < n)
+            capacity <<= 1;
+        return capacity;
+    }
+
+    static void Pause(int spin)
+    {
+        if (spin < SpinCount)
+            CpuRelax();
+        else
+            std::this_thread::yield();
+    }
+
+    // [next, next + n) 的槽位是否都已被所有消费者处理过
+    bool HasRoom(int64_t next, size_t n)
+    {
+        int64_t wrap = next + static_cast<int64_t>(n) - 1 - static_cast<int64_t>(_capacity);
+        // 多生产者时缓存值可能是别的生产者写的，用 acquire/release 把消费者的进度传递过来
+        if (wrap <= _cachedGate.load(std::memory_order_acquire))
+            return true;
+
+        int64_t gate = std::numeric_limits<int64_t>::max();
+        for (auto& consumer : _consumers)
+        {
+            int64_t seq = consumer->_sequence.load(std::memory_order_acquire);
+            if (seq < gate)
+                gate = seq;
+        }
+        _cachedGate.store(gate, std::memory_order_release);
+        return wrap <= gate;
+    }
+
+    // consumer 从 next 开始可以读到的最后一个序号
+    int64_t Available(const Consumer* consumer, int64_t next) const
+    {
+        int64_t available;
+        if (Producer == BroadcastProducer::Single)
+            available = _cursor.load(std::memory_order_acquire);
+        else
+        {
+            // 领取了但还没发布的序号会打断连续的一段
+            int64_t claimed = _next.load(std::memory_order_relaxed) - 1;
+            available = next - 1;
+            while (available < claimed && _published[(available + 1) & _mask].load(std::memory_order_acquire) == available + 1)
+                ++available;
+        }
+
+        for (const Consumer* dependency : consumer->_dependsOn)
+        {
+            int64_t seq = dependency->_sequence.load(std::memory_order_acquire);
+            if (seq < available)
+                available = seq;
+        }
+        return available;
+    }
+
+    const size_t _capacity;
+    const size_t _mask;
+    std::unique_ptr<T[]> _slots;
+    std::unique_ptr<std::atomic<int64_t>[]> _published; // 多生产者：每个槽位最近发布的序号
+    std::vector<std::unique_ptr<Consumer>> _consumers;
+
+    // 生产者区域
+    alignas(CacheLineSize) std::atomic<int64_t> _next; // 下一个要领取的序号
+    std::atomic<int64_t> _cachedGate;                  // 上次看到的最慢消费者的序号
+
+    // 单生产者的发布游标，消费者读取
+    alignas(CacheLineSize) std::atomic<int64_t> _cursor;
+
+    BroadcastRing(BroadcastRing const&) = delete;
+    BroadcastRing& operator=(BroadcastRing const&) = delete;
+};
+
+#endif
@@ -0,0 +1,37 @@
+// 缓存行大小，用于把不同线程写的字段分到不同缓存行上，避免伪共享
+//
+// C++ 下优先使用 std::hardware_destructive_interference_size，没有时退回 64 字节；
+// 编译时定义 MARK_CACHE_LINE_SIZE 可以覆盖（C 代码只用这个宏），
+// 例如 -DMARK_CACHE_LINE_SIZE=128 适配相邻行预取的 CPU，-DMARK_CACHE_LINE_SIZE=8 则相当于不做填充，用于对比测试。
+
+#ifndef _MARK_CACHE_LINE_H
+#define _MARK_CACHE_LINE_H
+
+#ifdef __cplusplus
+
+#include <cstddef>
+#include <new>
+
+#if defined(MARK_CACHE_LINE_SIZE)
+constexpr std::size_t CacheLineSize = MARK_CACHE_LINE_SIZE;
+#elif defined(__cpp_lib_hardware_interference_size)
+// 只在进程内使用，不涉及 ABI，关掉 GCC 对它取值随 -mtune 变化的提醒
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+constexpr std::size_t CacheLineSize = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+constexpr std::size_t CacheLineSize = 64;
+#endif
+
+#endif
+
+#ifndef MARK_CACHE_LINE_SIZE
+#define MARK_CACHE_LINE_SIZE 64
+#endif
+
+#endif
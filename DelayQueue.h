@@ -0,0 +1,317 @@
+// 延迟投递队列：多个生产者按截止时间入队，唯一的消费者在到期后按时间取出
+
+#ifndef _MARK_DELAY_QUEUE_H
+#define _MARK_DELAY_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "MPSCQueue.h"
+
+// 生产者把元素连同截止时间放进一个 MPSCQueueIntrusive（一次 exchange，无分配），
+// 消费者取出后放进分层时间轮，轮子和就绪链表都只由消费者访问，不需要加锁。
+// 时间轮和 msgqueue_put_at 的实现相同：Levels 层、每层 64 个槽位，第 L 层每个槽位覆盖 64^L 个 tick；
+// 第 0 层的槽位到期时整条链接到就绪链表上，进入上一层新的区间时把对应槽位按各自的截止时间降到下层。
+// 元素在时间轮里复用入队用的侵入式链接，截止时间存放在 Deadline 成员里，调度是 O(1) 且没有额外分配。
+// 消费者阻塞时睡到下一个截止时间（按 Tick 向上取整），期间有新元素入队会被唤醒重新计算。
+template<typename T, std::atomic<T*> T::* IntrusiveLink, std::chrono::steady_clock::time_point T::* Deadline>
+class DelayQueue
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static constexpr Clock::duration Tick = std::chrono::milliseconds(1);
+    static constexpr int Bits = 6;
+    static constexpr int Slots = 1 << Bits;
+    static constexpr int Levels = 4;
+
+    DelayQueue() : _now(NowTick()), _pending(0), _readyFirst(nullptr), _readyLast(nullptr)
+    {
+        for (int level = 0; level < Levels; ++level)
+        {
+            _bitmap[level] = 0;
+            for (int i = 0; i < Slots; ++i)
+                _slots[level][i].First = _slots[level][i].Last = nullptr;
+        }
+    }
+
+    // 还没到期的元素和已经到期没取走的元素都被释放
+    ~DelayQueue()
+    {
+        Drain();
+        DeleteList(_readyFirst);
+        for (int level = 0; level < Levels; ++level)
+            for (int i = 0; i < Slots; ++i)
+                DeleteList(_slots[level][i].First);
+    }
+
+    // 在 deadline 之后投递，多个生产者可以同时调用
+    void Enqueue(T* item, Clock::time_point deadline)
+    {
+        item->*Deadline = deadline;
+        _incoming.Enqueue(item);
+    }
+
+    template<typename Rep, typename Period>
+    void EnqueueAfter(T* item, std::chrono::duration<Rep, Period> const& delay)
+    {
+        Enqueue(item, Clock::now() + delay);
+    }
+
+    // 取出一个已经到期的元素，没有时返回 false，只能由消费者调用
+    bool Dequeue(T*& result)
+    {
+        Drain();
+        if (!_readyFirst)
+            Advance(NowTick());
+        return PopReady(result);
+    }
+
+    // 阻塞直到有元素到期
+    void DequeueWait(T*& result)
+    {
+        while (!Dequeue(result))
+            WaitNext(nullptr);
+    }
+
+    // 带超时的阻塞出队，超时返回 false
+    template<typename Rep, typename Period>
+    bool DequeueWaitFor(T*& result, std::chrono::duration<Rep, Period> const& timeout)
+    {
+        Clock::time_point deadline = Clock::now() + timeout;
+        while (!Dequeue(result))
+        {
+            if (Clock::now() >= deadline)
+                return false;
+            WaitNext(&deadline);
+        }
+        return true;
+    }
+
+    // 还没取走的元素个数（包括未到期的），只能由消费者调用，不含尚未被消费者看到的新入队元素
+    size_t Pending() const { return _pending; }
+
+    // 入队一侧的统计快照
+    QueueStatsSnapshot Stats() const { return _incoming.Stats(); }
+
+private:
+    struct Slot
+    {
+        T* First;
+        T* Last;
+    };
+
+    static uint64_t NowTick() { return TickOf(Clock::now(), false); }
+
+    // 截止时间向上取整，保证不会提前投递
+    static uint64_t TickOf(Clock::time_point time, bool roundUp)
+    {
+        Clock::duration since = time.time_since_epoch();
+        if (since.count() < 0)
+            return 0;
+        uint64_t tick = since / Tick;
+        if (roundUp && Clock::duration(tick * Tick) < since)
+            ++tick;
+        return tick;
+    }
+
+    static T* Next(T* item) { return (item->*IntrusiveLink).load(std::memory_order_relaxed); }
+    static void SetNext(T* item, T* next) { (item->*IntrusiveLink).store(next, std::memory_order_relaxed); }
+
+    static void DeleteList(T* item)
+    {
+        while (item)
+        {
+            T* next = Next(item);
+            delete item;
+            item = next;
+        }
+    }
+
+    // 把生产者新放入的元素全部挪进时间轮或就绪链表。
+    // 先看是否为空，取完时不再多一次失败的出队，免得每次调用都记一次空轮询
+    void Drain()
+    {
+        T* item;
+        while (!_incoming.Empty() && _incoming.Dequeue(item))
+            Schedule(item);
+    }
+
+    void Schedule(T* item)
+    {
+        ++_pending;
+        uint64_t tick = TickOf(item->*Deadline, true);
+        if (tick <= _now)
+            PushReady(item, item);
+        else
+            Link(item, tick);
+    }
+
+    void PushReady(T* first, T* last)
+    {
+        SetNext(last, nullptr);
+        if (_readyLast)
+            SetNext(_readyLast, first);
+        else
+            _readyFirst = first;
+        _readyLast = last;
+    }
+
+    bool PopReady(T*& result)
+    {
+        if (!_readyFirst)
+            return false;
+
+        result = _readyFirst;
+        _readyFirst = Next(result);
+        if (!_readyFirst)
+            _readyLast = nullptr;
+        --_pending;
+        return true;
+    }
+
+    // 放进 tick 对应的槽位，tick > _now
+    void Link(T* item, uint64_t tick)
+    {
+        uint64_t delta = tick - _now;
+        int level = 0;
+        while (level < Levels - 1 && (delta >> (Bits * (level + 1))))
+            ++level;
+
+        // 超出最高层范围的先放在最高层最远的槽位，到时再按真正的截止时间重新放置
+        if (delta >> (Bits * Levels))
+            tick = _now + (uint64_t(1) << (Bits * Levels)) - 1;
+
+        int index = (tick >> (Bits * level)) & (Slots - 1);
+        Slot& slot = _slots[level][index];
+        SetNext(item, nullptr);
+        if (slot.Last)
+            SetNext(slot.Last, item);
+        else
+            slot.First = item;
+        slot.Last = item;
+        _bitmap[level] |= uint64_t(1) << index;
+    }
+
+    T* Take(int level, int index)
+    {
+        Slot& slot = _slots[level][index];
+        T* first = slot.First;
+        slot.First = slot.Last = nullptr;
+        _bitmap[level] &= ~(uint64_t(1) << index);
+        return first;
+    }
+
+    // 把时间轮推进到 target，到期的元素接到就绪链表
+    void Advance(uint64_t target)
+    {
+        while (_now < target && HasTimers())
+        {
+            // 下一个要处理的 tick：第 0 层下一个非空槽位，或者下一个 64 tick 区间的开始
+            int cur = _now & (Slots - 1);
+            uint64_t mask = cur == Slots - 1 ? 0 : _bitmap[0] & (~uint64_t(0) << (cur + 1));
+            uint64_t next = mask ? _now - cur + __builtin_ctzll(mask) : (_now | (Slots - 1)) + 1;
+            if (next > target)
+                break;
+
+            _now = next;
+            for (int level = Levels - 1; level > 0; --level)
+            {
+                if (next & ((uint64_t(1) << (Bits * level)) - 1))
+                    continue;
+
+                T* item = Take(level, (next >> (Bits * level)) & (Slots - 1));
+                while (item)
+                {
+                    T* following = Next(item);
+                    uint64_t tick = TickOf(item->*Deadline, true);
+                    if (tick <= next)
+                        PushReady(item, item);
+                    else
+                        Link(item, tick);
+                    item = following;
+                }
+            }
+
+            int index = next & (Slots - 1);
+            Slot& slot = _slots[0][index];
+            if (slot.First)
+            {
+                T* last = slot.Last;
+                PushReady(Take(0, index), last);
+            }
+        }
+
+        if (_now < target)
+            _now = target;
+    }
+
+    bool HasTimers() const
+    {
+        for (int level = 0; level < Levels; ++level)
+            if (_bitmap[level])
+                return true;
+        return false;
+    }
+
+    // 时间轮下一次需要处理的 tick：第 0 层最早的非空槽位，或更高层非空槽位所在区间的开始（到时降层）
+    uint64_t NextTick() const
+    {
+        uint64_t best = ~uint64_t(0);
+        for (int level = 0; level < Levels; ++level)
+        {
+            uint64_t bm = _bitmap[level];
+            if (!bm)
+                continue;
+
+            uint64_t base = _now >> (Bits * level);
+            int cur = (base + 1) & (Slots - 1);
+            uint64_t rot = cur ? (bm >> cur) | (bm << (Slots - cur)) : bm;
+            uint64_t tick = (base + 1 + __builtin_ctzll(rot)) << (Bits * level);
+            if (tick < best)
+                best = tick;
+        }
+        return best;
+    }
+
+    // 等到时间轮下一次需要处理、有新元素入队或 deadline，先到者为准
+    void WaitNext(const Clock::time_point* deadline)
+    {
+        T* item;
+        bool got;
+        if (HasTimers())
+        {
+            Clock::time_point wake = Clock::time_point(NextTick() * Tick);
+            if (deadline && *deadline < wake)
+                wake = *deadline;
+            got = _incoming.DequeueWaitFor(item, wake - Clock::now());
+        }
+        else if (deadline)
+            got = _incoming.DequeueWaitFor(item, *deadline - Clock::now());
+        else
+        {
+            _incoming.DequeueWait(item);
+            got = true;
+        }
+
+        if (got)
+            Schedule(item);
+    }
+
+    MPSCQueueIntrusive<T, IntrusiveLink> _incoming; // 生产者到消费者
+
+    // 以下只由消费者访问
+    uint64_t _now; // 已经处理到的 tick
+    size_t _pending;
+    uint64_t _bitmap[Levels]; // 每层非空槽位的位图
+    Slot _slots[Levels][Slots];
+    T* _readyFirst; // 已经到期的元素，按到期顺序
+    T* _readyLast;
+
+    DelayQueue(DelayQueue const&) = delete;
+    DelayQueue& operator=(DelayQueue const&) = delete;
+};
+
+#endif
@@ -0,0 +1,39 @@
+// Linux futex 的简单封装，供需要阻塞等待的无锁队列使用
+
+#ifndef _MARK_FUTEX_H
+#define _MARK_FUTEX_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// 如果 *addr 仍等于 expected 则睡眠，直到被唤醒或超时（timeout 为相对时间，nullptr 表示不超时）
+// addr 位于多个进程共享的内存里时 shared 必须为 true，否则内核只在本进程内匹配等待者
+inline void FutexWait(std::atomic<uint32_t>* addr, uint32_t expected, const struct timespec* timeout = nullptr,
+    bool shared = false)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, expected, timeout,
+        nullptr, 0);
+}
+
+// 唤醒最多 count 个在 addr 上睡眠的线程
+inline void FutexWake(std::atomic<uint32_t>* addr, int count, bool shared = false)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, count, nullptr,
+        nullptr, 0);
+}
+
+// 自旋等待时让出流水线资源
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+#endif
@@ -0,0 +1,255 @@
+// 无界的多生产者多消费者无锁链表队列
+
+#ifndef _MARK_LINKED_MPMC_QUEUE_H
+#define _MARK_LINKED_MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "CacheLine.h"
+#include "Reclaimer.h"
+
+// Michael-Scott 队列：链表带一个 dummy 头节点，生产者 CAS 尾节点的 next 挂上新节点，
+// 消费者 CAS 头指针前进一步，落后的尾指针由任何线程顺手推进。
+// MPSCQueueNonIntrusive 的消费者出队后直接释放旧的头节点，只在单消费者时成立；
+// 这里多个消费者可能同时读着同一个头节点，旧头节点交给回收域（Reclaimer.h），
+// 等没有线程还能访问它时再放回队列自己的节点池，所以稳定状态下不再分配内存。
+// 节点在回收之前不会被复用，CAS 也就不会遇到 ABA。
+//
+// Reclaimer 可选 HazardPointerDomain<2>（默认，未回收节点数有上界）或 EpochDomain
+// （读取更便宜，但停在操作中间的线程会拖住所有回收）。
+// 元素按值存放，支持只能移动的类型：消费者 CAS 成功后才把值从新的 dummy 节点里移出来，
+// 而这个节点在它的保护之下。
+template<typename T, typename Reclaimer = HazardPointerDomain<2>>
+class LinkedMPMCQueue
+{
+    struct Node
+    {
+        std::atomic<Node*> Next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type Value;
+
+        T* Get() { return reinterpret_cast<T*>(&Value); }
+    };
+
+    // 空闲节点复用节点本身的内存，线程本地缓存用完时一次取走整条共享空闲链
+    struct FreeNode
+    {
+        FreeNode* Next;
+    };
+
+    // 回收的节点，只压栈，取的时候整条取走
+    struct FreeStack
+    {
+        std::atomic<FreeNode*> Top;
+
+        FreeStack() : Top(nullptr) {}
+
+        ~FreeStack()
+        {
+            FreeNode* node = Top.load(std::memory_order_acquire);
+            while (node)
+            {
+                FreeNode* next = node->Next;
+                ::operator delete(node);
+                node = next;
+            }
+        }
+    };
+
+    struct LocalCache
+    {
+        uint64_t Owner = 0; // 缓存所属队列的 id，0 表示空
+        FreeNode* List = nullptr;
+
+        void Reset(uint64_t owner)
+        {
+            while (List)
+            {
+                FreeNode* next = List->Next;
+                ::operator delete(List);
+                List = next;
+            }
+            Owner = owner;
+        }
+
+        ~LocalCache() { Reset(0); }
+    };
+
+public:
+    LinkedMPMCQueue()
+        : _id(NextId()), _reclaimer(&LinkedMPMCQueue::Recycle, this)
+    {
+        Node* dummy = new (Allocate()) Node;
+        dummy->Next.store(nullptr, std::memory_order_relaxed);
+        _head.store(dummy, std::memory_order_relaxed);
+        _tail.store(dummy, std::memory_order_relaxed);
+    }
+
+    // 析构时不应再有并发访问。其它线程缓存里的节点在那些线程退出或切换到别的队列时释放
+    ~LinkedMPMCQueue()
+    {
+        LocalCache& cache = Local();
+        if (cache.Owner == _id)
+            cache.Reset(0);
+
+        Node* node = _head.load(std::memory_order_relaxed);
+        Node* next = node->Next.load(std::memory_order_relaxed);
+        ::operator delete(node);
+        while (next)
+        {
+            node = next;
+            next = node->Next.load(std::memory_order_relaxed);
+            node->Get()->~T();
+            ::operator delete(node);
+        }
+    }
+
+    void Enqueue(const T& item) { Emplace(item); }
+    void Enqueue(T&& item) { Emplace(std::move(item)); }
+
+    template<typename... Args>
+    void Emplace(Args&&... args)
+    {
+        Node* node = new (Allocate()) Node;
+        try
+        {
+            new (&node->Value) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            Recycle(this, node);
+            throw;
+        }
+        node->Next.store(nullptr, std::memory_order_relaxed);
+
+        typename Reclaimer::Guard guard(_reclaimer);
+        for (;;)
+        {
+            Node* tail = guard.Protect(0, _tail);
+            Node* next = tail->Next.load(std::memory_order_acquire);
+            if (tail != _tail.load(std::memory_order_acquire))
+                continue;
+
+            if (next)
+            {
+                // 尾指针落后了，帮忙推进
+                _tail.compare_exchange_weak(tail, next, std::memory_order_release, std::memory_order_relaxed);
+                continue;
+            }
+
+            if (tail->Next.compare_exchange_weak(next, node, std::memory_order_release, std::memory_order_relaxed))
+            {
+                _tail.compare_exchange_strong(tail, node, std::memory_order_release, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    // 队列为空时返回 false
+    bool Dequeue(T& result)
+    {
+        typename Reclaimer::Guard guard(_reclaimer);
+        for (;;)
+        {
+            Node* head = guard.Protect(0, _head);
+            Node* tail = _tail.load(std::memory_order_acquire);
+            Node* next = guard.Protect(1, head->Next);
+            if (head != _head.load(std::memory_order_acquire))
+                continue;
+
+            if (!next)
+                return false;
+
+            if (head == tail)
+            {
+                // 新节点已经挂上但尾指针还没推进，先推进尾指针，保证头不会越过尾
+                _tail.compare_exchange_weak(tail, next, std::memory_order_release, std::memory_order_relaxed);
+                continue;
+            }
+
+            if (_head.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                // next 成为新的 dummy，它的值只有本线程会取
+                T* value = next->Get();
+                result = std::move(*value);
+                value->~T();
+                guard.Retire(head);
+                return true;
+            }
+        }
+    }
+
+    // 调用时刻的近似判断。要读 head->Next，和 Dequeue 一样先保护 head，防止它被回收
+    bool Empty() const
+    {
+        typename Reclaimer::Guard guard(_reclaimer);
+        for (;;)
+        {
+            Node* head = guard.Protect(0, _head);
+            Node* tail = _tail.load(std::memory_order_acquire);
+            Node* next = head->Next.load(std::memory_order_acquire);
+            if (head != _head.load(std::memory_order_acquire))
+                continue;
+            return head == tail && !next;
+        }
+    }
+
+private:
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> id(0);
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    static LocalCache& Local()
+    {
+        static thread_local LocalCache cache;
+        return cache;
+    }
+
+    void* Allocate()
+    {
+        LocalCache& cache = Local();
+        if (cache.Owner != _id)
+            cache.Reset(_id);
+
+        FreeNode* node = cache.List;
+        if (!node)
+        {
+            node = _free.Top.exchange(nullptr, std::memory_order_acquire);
+            if (!node)
+                return ::operator new(sizeof(Node));
+        }
+
+        cache.List = node->Next;
+        return node;
+    }
+
+    // 回收域确认安全后调用，可能在任意线程上；只压栈不弹单个节点，所以没有 ABA
+    static void Recycle(void* context, void* p)
+    {
+        LinkedMPMCQueue* queue = static_cast<LinkedMPMCQueue*>(context);
+        FreeNode* node = static_cast<FreeNode*>(p);
+        FreeNode* head = queue->_free.Top.load(std::memory_order_relaxed);
+        do
+            node->Next = head;
+        while (!queue->_free.Top.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    const uint64_t _id;
+    alignas(CacheLineSize) std::atomic<Node*> _head;
+    alignas(CacheLineSize) std::atomic<Node*> _tail;
+    alignas(CacheLineSize) FreeStack _free;
+
+    // 回收域析构时会把剩下的退休节点交给 Recycle，所以放在 _free 之后声明、先析构
+    mutable Reclaimer _reclaimer; // Empty 也要进入回收域
+
+    LinkedMPMCQueue(LinkedMPMCQueue const&) = delete;
+    LinkedMPMCQueue& operator=(LinkedMPMCQueue const&) = delete;
+};
+
+#endif
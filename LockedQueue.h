@@ -1,17 +1,95 @@
 #ifndef MARK_LOCKEDQUEUE_H
 #define MARK_LOCKEDQUEUE_H
 
+#include<cstddef>
 #include<deque>
+#include<functional>
 #include<mutex>
+#include<utility>
 
-template<class T,typename StorageType=std::deque<T>>
+#include"QueueStats.h"
+
+//LockType 可以换成 SpinLock.h 里的 TicketSpinLock 或 SpinFutexLock，临界区很短时减少进内核的次数
+//
+//有界用法：构造时给出容量，try_add/try_emplace 在队列满时返回 false 而不是继续增长；
+//上游也可以先用 reserve 预占名额（信用），再用 add_reserved 入队，名额在元素被取走时归还；
+//没有名额时 add_reserved 和 try_add 一样检查容量。
+//add/emplace 不检查容量。set_watermarks 设置高低水位回调，回调在锁外调用，彼此串行。
+template<class T,typename StorageType=std::deque<T>,typename LockType=std::mutex>
 class LockedQueue{
-    std::mutex _lock;
+public:
+    typedef std::function<void(bool high)> WatermarkCallback;
+
+private:
+    LockType _lock;
     StorageType _queue;
     volatile bool _canceled;   //该变量可能会在程序的控制之外被修改，告诉编译器不要对这个变量的读取和写入进行优化
+    QueueStats _stats;         //运行统计，只有定义 MARK_QUEUE_STATS 时才有开销
+    size_t _capacity;          //0 表示不限
+    size_t _reserved;          //已经发放、还没有入队的名额
+    size_t _lowMark;
+    size_t _highMark;
+    bool _aboveHigh;           //元素数到过高水位，还没回到低水位
+    bool _reportedHigh;        //最后一次回调报告的是高水位，由 _markLock 保护
+    std::mutex _markLock;      //串行化水位回调
+    WatermarkCallback _watermark;
+
+    //水位变化：0 没有变化，1 到达高水位，-1 回到低水位
+    enum { NoMark=0, HighMark=1, LowMark=-1 };
+
+    //以下函数在持有锁时调用
+    int onPush(){
+        _stats.OnEnqueue();
+        _stats.OnDepth(_queue.size());
+        _stats.TracePush();
+        return checkMark();
+    }
+
+    int onPop(){
+        _stats.OnDequeue();
+        _stats.TracePop();
+        return checkMark();
+    }
+
+    bool full() const{
+        return _capacity && _queue.size()+_reserved>=_capacity;
+    }
+
+    int checkMark(){
+        if(!_watermark)
+            return NoMark;
+        if(!_aboveHigh&&_queue.size()>=_highMark){
+            _aboveHigh=true;
+            return HighMark;
+        }
+        if(_aboveHigh&&_queue.size()<=_lowMark){
+            _aboveHigh=false;
+            return LowMark;
+        }
+        return NoMark;
+    }
+
+    //在锁外调用。不同线程算出的变化可能乱序到达这里，所以不直接报告 mark，
+    //而是在回调锁内重读当前状态，只在和上次报告的不同时回调：
+    //过时的变化被丢掉，回调仍然高低交替，最后报告的总是当前状态
+    void notifyMark(int mark){
+        if(mark==NoMark)
+            return;
+        std::lock_guard<std::mutex> markLock(_markLock);
+        bool high;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            high=_aboveHigh;
+        }
+        if(high!=_reportedHigh){
+            _reportedHigh=high;
+            _watermark(high);
+        }
+    }
 
 public:
-    LockedQueue():_canceled(false)
+    explicit LockedQueue(size_t capacity=0)
+        :_canceled(false),_capacity(capacity),_reserved(0),_lowMark(0),_highMark(0),_aboveHigh(false),_reportedHigh(false)
     {    
     }
     virtual ~LockedQueue()
@@ -19,45 +97,175 @@ public:
     }
 
     void add(const T& item){   //引用方式传递，避免调用拷贝构造函数，提高性能
-        lock();
-        _queue.push_back(item);
-        unlock();
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            QueueStats::HoldTimer hold(_stats);
+            _queue.push_back(item);
+            mark=onPush();
+        }
+        notifyMark(mark);
+    }
+
+    //右值版本，大对象在锁内只做移动不做深拷贝
+    void add(T&& item){
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            QueueStats::HoldTimer hold(_stats);
+            _queue.push_back(std::move(item));
+            mark=onPush();
+        }
+        notifyMark(mark);
+    }
+
+    //在队列中直接构造元素
+    template<class... Args>
+    void emplace(Args&&... args){
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            QueueStats::HoldTimer hold(_stats);
+            _queue.emplace_back(std::forward<Args>(args)...);
+            mark=onPush();
+        }
+        notifyMark(mark);
+    }
+
+    //队列满（元素数加已发放的名额达到容量）时不入队，返回 false
+    bool try_add(const T& item){
+        return try_emplace(item);
     }
 
-    //将范围内的元素添回队列的前端
+    bool try_add(T&& item){
+        return try_emplace(std::move(item));
+    }
+
+    template<class... Args>
+    bool try_emplace(Args&&... args){
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            QueueStats::HoldTimer hold(_stats);
+            if(full())
+                return false;
+            _queue.emplace_back(std::forward<Args>(args)...);
+            mark=onPush();
+        }
+        notifyMark(mark);
+        return true;
+    }
+
+    //预占最多 n 个名额，返回实际得到的个数，没有容量限制时总是得到 n 个
+    size_t reserve(size_t n){
+        std::lock_guard<LockType> lock(_lock);
+        if(_capacity){
+            size_t used=_queue.size()+_reserved;
+            size_t left=used<_capacity?_capacity-used:0;
+            if(n>left)
+                n=left;
+        }
+        _reserved+=n;
+        return n;
+    }
+
+    //用一个预占的名额入队，持有名额时不会失败。
+    //没有已发放的名额时（调用方多用了名额）按 try_add 处理，队列满返回 false，不让队列越过容量
+    bool add_reserved(T item){
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            QueueStats::HoldTimer hold(_stats);
+            if(_reserved)
+                --_reserved;
+            else if(full())
+                return false;
+            _queue.push_back(std::move(item));
+            mark=onPush();
+        }
+        notifyMark(mark);
+        return true;
+    }
+
+    //归还没有用掉的名额
+    void unreserve(size_t n){
+        std::lock_guard<LockType> lock(_lock);
+        _reserved-=n<_reserved?n:_reserved;
+    }
+
+    //元素个数升到 high 时以 true 调用 callback，之后降到 low 时以 false 调用，交替进行。
+    //回调在锁外、在入队或出队的线程上调用，彼此串行，不能在回调里访问本队列。
+    //需要在队列开始使用之前设置
+    void set_watermarks(size_t low,size_t high,WatermarkCallback callback){
+        std::lock_guard<std::mutex> markLock(_markLock);
+        std::lock_guard<LockType> lock(_lock);
+        _lowMark=low;
+        _highMark=high;
+        _watermark=std::move(callback);
+        _aboveHigh=false;
+        _reportedHigh=false;
+    }
+
+    size_t capacity() const{
+        return _capacity;
+    }
+
+    //将范围内的元素添回队列的前端。计入入队次数，但不参与逗留时间采样（采样按先进先出配对）
     template<class Iterator>
     void readd(Iterator begin, Iterator end)
     {
-        std::lock_guard<std::mutex> lock(_lock);
-        _queue.insert(_queue.begin(), begin, end);
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            size_t before=_queue.size();
+            _queue.insert(_queue.begin(), begin, end);
+            _stats.OnEnqueue(_queue.size()-before);
+            _stats.OnDepth(_queue.size());
+            mark=checkMark();
+        }
+        notifyMark(mark);
     }
 
     //拿出队列中的第一个元素
     bool next(T& result){
-        std::lock_guard<std::mutex> lock(_lock);
-        if(_queue.empty()){
-            return false;
-        }
-
-        result=_queue.front();
-        _queue.pop_front();
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            QueueStats::HoldTimer hold(_stats);
+            if(_queue.empty()){
+                _stats.OnEmptyPoll();
+                return false;
+            }
 
+            result=std::move(_queue.front());   //移动出队，支持只能移动的类型
+            _queue.pop_front();
+            mark=onPop();
+        }
+        notifyMark(mark);
         return true;
     }
 
     //函数重载
     template<class Checker>
     bool next(T& result,Checker& check){
-        std::lock_guard<std::mutex> lock(_lock);
-        if(_queue.empty()){
-            return false;
-        }
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            QueueStats::HoldTimer hold(_stats);
+            if(_queue.empty()){
+                _stats.OnEmptyPoll();
+                return false;
+            }
 
-        result=_queue.front();
-        if(!check.Process(result)){
-            return false;
+            //先在队首原地检查，通过后再移动出来，检查不通过时元素保持原样
+            if(!check.Process(_queue.front())){
+                return false;
+            }
+            result=std::move(_queue.front());
+            _queue.pop_front();
+            mark=onPop();
         }
-        _queue.pop_front();
+        notifyMark(mark);
         return true;
     }
 
@@ -75,7 +283,7 @@ public:
     //! Cancels the queue.
     void cancel()
     {
-        std::lock_guard<std::mutex> lock(_lock);
+        std::lock_guard<LockType> lock(_lock);
 
         _canceled = true;
     }
@@ -83,7 +291,7 @@ public:
     //! Checks if the queue is cancelled.
     bool cancelled()
     {
-        std::lock_guard<std::mutex> lock(_lock);
+        std::lock_guard<LockType> lock(_lock);
         return _canceled;
     }
 
@@ -104,14 +312,25 @@ public:
     ///! Calls pop_front of the queue
     void pop_front()
     {
-        std::lock_guard<std::mutex> lock(_lock);
-        _queue.pop_front();
+        int mark;
+        {
+            std::lock_guard<LockType> lock(_lock);
+            _queue.pop_front();
+            mark=onPop();
+        }
+        notifyMark(mark);
+    }
+
+    //! Returns a snapshot of the queue statistics (all zero without MARK_QUEUE_STATS)
+    QueueStatsSnapshot stats() const
+    {
+        return _stats.Snapshot();
     }
 
     ///! Checks if we're empty or not with locks held
     bool empty()
     {
-        std::lock_guard<std::mutex> lock(_lock);
+        std::lock_guard<LockType> lock(_lock);
         return _queue.empty();
     }
 
@@ -0,0 +1,168 @@
+// 多生产者多消费者的无锁有界队列
+
+#ifndef _MARK_MPMC_QUEUE_H
+#define _MARK_MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "CacheLine.h"
+
+// Dmitry Vyukov 的有界 MPMC 队列：每个槽位带一个序号，
+// 序号等于入队位置时槽位可写，等于出队位置 + 1 时槽位可读，
+// 生产者和消费者各自只用一次 CAS 抢占位置，不需要锁。
+// 元素按值存放，支持只能移动的类型；接口与 LockedQueue 保持一致，便于替换。
+template<typename T>
+class MPMCQueue
+{
+public:
+    // capacity 会向上取整到 2 的幂，至少为 2
+    explicit MPMCQueue(size_t capacity)
+        : _capacity(RoundUp(capacity)), _mask(_capacity - 1),
+        _cells(static_cast<Cell*>(::operator new(sizeof(Cell) * _capacity))),
+        _enqueuePos(0), _dequeuePos(0), _canceled(false)
+    {
+        for (size_t i = 0; i < _capacity; ++i)
+            new (&_cells[i].Sequence) std::atomic<size_t>(i);
+    }
+
+    virtual ~MPMCQueue()
+    {
+        // 析构时不应再有并发访问，直接析构还留在队列中的元素
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        size_t end = _enqueuePos.load(std::memory_order_relaxed);
+        for (; pos != end; ++pos)
+            reinterpret_cast<T*>(&_cells[pos & _mask].Storage)->~T();
+        for (size_t i = 0; i < _capacity; ++i)
+            _cells[i].Sequence.~atomic();
+        ::operator delete(_cells);
+    }
+
+    // 入队，队列满时返回 false
+    bool try_push(const T& item) { return try_emplace(item); }
+    bool try_push(T&& item) { return try_emplace(std::move(item)); }
+
+    template<typename... Args>
+    bool try_emplace(Args&&... args)
+    {
+        Cell* cell;
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &_cells[pos & _mask];
+            size_t seq = cell->Sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // 槽位还没被消费，队列已满
+            else
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+
+        new (&cell->Storage) T(std::forward<Args>(args)...);
+        cell->Sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 出队，队列空时返回 false
+    bool try_pop(T& result)
+    {
+        Cell* cell;
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &_cells[pos & _mask];
+            size_t seq = cell->Sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // 槽位还没被写入，队列为空
+            else
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+        }
+
+        T* element = reinterpret_cast<T*>(&cell->Storage);
+        result = std::move(*element);
+        element->~T();
+        // 槽位留给下一圈的生产者
+        cell->Sequence.store(pos + _capacity, std::memory_order_release);
+        return true;
+    }
+
+    // 与 LockedQueue 相同的接口，add 在队列满时让出 CPU 直到入队成功
+    void add(const T& item)
+    {
+        while (!try_push(item))
+            std::this_thread::yield();
+    }
+
+    void add(T&& item)
+    {
+        while (!try_push(std::move(item)))
+            std::this_thread::yield();
+    }
+
+    bool next(T& result) { return try_pop(result); }
+
+    //! Cancels the queue.
+    void cancel()
+    {
+        _canceled.store(true, std::memory_order_release);
+    }
+
+    //! Checks if the queue is cancelled.
+    bool cancelled()
+    {
+        return _canceled.load(std::memory_order_acquire);
+    }
+
+    ///! Approximate emptiness check
+    bool empty()
+    {
+        return _dequeuePos.load(std::memory_order_acquire) >= _enqueuePos.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return _capacity; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> Sequence;
+        std::aligned_storage_t<sizeof(T), alignof(T)> Storage;
+    };
+
+    static size_t RoundUp(size_t n)
+    {
+        size_t capacity = 2;
+        while (capacity < n)
+            capacity <<= 1;
+        return capacity;
+    }
+
+    const size_t _capacity;
+    const size_t _mask;
+    Cell* const _cells;
+
+    // 生产者和消费者的位置分别放在独立的缓存行上
+    alignas(CacheLineSize) std::atomic<size_t> _enqueuePos;
+    alignas(CacheLineSize) std::atomic<size_t> _dequeuePos;
+    alignas(CacheLineSize) std::atomic<bool> _canceled;
+
+    MPMCQueue(MPMCQueue const&) = delete;
+    MPMCQueue& operator=(MPMCQueue const&) = delete;
+};
+
+#endif
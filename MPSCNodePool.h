@@ -0,0 +1,176 @@
+// MPSCQueueNonIntrusive 使用的节点池分配器
+
+#ifndef _MARK_MPSC_NODE_POOL_H
+#define _MARK_MPSC_NODE_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "CacheLine.h"
+
+// 节点由生产者分配、由唯一的消费者释放，这正是全局分配器最怕的跨线程释放模式。
+// 这里消费者把释放的节点压入一个无锁归还栈，生产者在自己的线程缓存用完时，
+// 用一次 exchange 把整条归还链取走，之后在本线程内不带任何原子操作地逐个分配。
+// 归还栈只有消费者一个压入方，生产者只做整链 exchange，因此不存在 ABA 问题。
+//
+// 线程缓存按节点类型区分，每个线程同一时刻只缓存一个池的节点；
+// 同一个线程交替给两个同类型的池化队列生产时，切换池会把旧缓存直接还给系统。
+template<typename Node>
+class MPSCNodePool
+{
+    // 空闲节点复用节点本身的内存
+    struct FreeNode
+    {
+        FreeNode* Next;
+        size_t Depth; // 归还栈中从该节点到栈底的节点数，只在栈顶节点上有意义
+    };
+
+    static constexpr size_t BlockSize = sizeof(Node) > sizeof(FreeNode) ? sizeof(Node) : sizeof(FreeNode);
+
+    // 生产者线程本地缓存
+    struct LocalCache
+    {
+        uint64_t Owner = 0; // 缓存所属池的 id，0 表示空
+        FreeNode* List = nullptr;
+
+        void Reset(uint64_t owner)
+        {
+            while (List)
+            {
+                FreeNode* next = List->Next;
+                ::operator delete(List);
+                List = next;
+            }
+            Owner = owner;
+        }
+
+        ~LocalCache() { Reset(0); }
+    };
+
+public:
+    static constexpr size_t Unbounded = SIZE_MAX;
+
+    // maxPooled 限制归还栈中的空闲节点数，超出的节点直接还给系统。
+    // 生产者取走的整条链在它的线程缓存里，不计入这个数，所以空闲节点最多约为
+    // maxPooled × (生产者线程数 + 1)，按这个估算内存占用
+    explicit MPSCNodePool(size_t maxPooled = Unbounded)
+        : _id(NextId()), _maxPooled(maxPooled), _pooled(0), _hits(0), _misses(0), _releases(0),
+        _returned(nullptr), _lastPushed(nullptr), _lastDepth(0)
+    {
+    }
+
+    ~MPSCNodePool()
+    {
+        FreeNode* node = _returned.exchange(nullptr, std::memory_order_acquire);
+        while (node)
+        {
+            FreeNode* next = node->Next;
+            ::operator delete(node);
+            node = next;
+        }
+
+        // 其它线程缓存里的节点在那些线程退出或切换到别的池时释放
+        LocalCache& cache = Local();
+        if (cache.Owner == _id)
+            cache.Reset(0);
+    }
+
+    // 分配一个节点的内存，由生产者调用
+    void* Allocate()
+    {
+        LocalCache& cache = Local();
+        if (cache.Owner != _id)
+            cache.Reset(_id);
+
+        FreeNode* node = cache.List;
+        if (!node)
+        {
+            // 本地缓存用完，一次性取走消费者归还的整条链
+            node = _returned.exchange(nullptr, std::memory_order_acquire);
+            if (!node)
+            {
+                _misses.fetch_add(1, std::memory_order_relaxed);
+                return ::operator new(BlockSize);
+            }
+
+            _pooled.fetch_sub(node->Depth, std::memory_order_relaxed);
+        }
+
+        // 按实际交出的节点计数，缓存里没用上、后来随 Reset 释放的节点不算命中
+        _hits.fetch_add(1, std::memory_order_relaxed);
+        cache.List = node->Next;
+        return node;
+    }
+
+    // 归还一个节点的内存，只能由消费者调用
+    void Deallocate(void* p)
+    {
+        ptrdiff_t pooled = _pooled.load(std::memory_order_relaxed);
+        if (pooled >= 0 && static_cast<size_t>(pooled) >= _maxPooled)
+        {
+            _releases.fetch_add(1, std::memory_order_relaxed);
+            ::operator delete(p);
+            return;
+        }
+
+        // 节点一旦压栈就可能被生产者取走，所以深度只记在消费者本地，压栈后不再读节点
+        FreeNode* node = static_cast<FreeNode*>(p);
+        size_t depth = _lastDepth + 1;
+        node->Next = _lastPushed;
+        node->Depth = depth;
+        // 只有消费者会压栈，CAS 失败只可能是生产者把整条链取走了，此时栈一定为空
+        if (!_returned.compare_exchange_strong(_lastPushed, node, std::memory_order_release, std::memory_order_relaxed))
+        {
+            depth = 1;
+            node->Next = nullptr;
+            node->Depth = depth;
+            _returned.store(node, std::memory_order_release);
+        }
+
+        _lastPushed = node;
+        _lastDepth = depth;
+        _pooled.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void SetMaxPooled(size_t maxPooled) { _maxPooled = maxPooled; }
+    size_t MaxPooled() const { return _maxPooled; }
+
+    // 统计：由池中节点满足的分配次数、回落到系统分配的次数、因超出上限被还给系统的节点数
+    uint64_t Hits() const { return _hits.load(std::memory_order_relaxed); }
+    uint64_t Misses() const { return _misses.load(std::memory_order_relaxed); }
+    uint64_t Releases() const { return _releases.load(std::memory_order_relaxed); }
+
+private:
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> id(0);
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    static LocalCache& Local()
+    {
+        static thread_local LocalCache cache;
+        return cache;
+    }
+
+    const uint64_t _id;
+    size_t _maxPooled;
+    std::atomic<ptrdiff_t> _pooled; // 归还栈中的节点数（不含线程缓存），生产者取链时会短暂偏小
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _releases;
+
+    // 生产者和消费者都会访问归还栈，单独放一个缓存行
+    alignas(CacheLineSize) std::atomic<FreeNode*> _returned;
+
+    // 以下只由消费者访问
+    alignas(CacheLineSize) FreeNode* _lastPushed;
+    size_t _lastDepth;
+
+    MPSCNodePool(MPSCNodePool const&) = delete;
+    MPSCNodePool& operator=(MPSCNodePool const&) = delete;
+};
+
+#endif
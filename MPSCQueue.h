@@ -3,17 +3,123 @@
 #define _MARK_MPSC_QUEUE_H
 
 #include <atomic>  // 包含原子操作相关的头文件，用于实现线程安全的队列操作
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>     // placement new
+#include <thread>
 #include <utility> // 包含一些常用的工具函数和类型
 
+#include "CacheLine.h"
+#include "Futex.h"
+#include "QueueStats.h"
+
+// 消费者阻塞等待的公共部分，两种队列共用
+// 消费者先自旋一小段时间，只有确认队列为空（没有进行到一半的入队）后才在 _waiting 上睡眠；
+// 生产者在 exchange _head 之后读一次 _waiting，只有消费者确实睡着时才发起唤醒系统调用。
+// _head 的 exchange、_waiting 的写和空判断中对 _head 的读都是 seq_cst，
+// 保证生产者看到消费者在睡，或者消费者看到新的 _head，不会丢失唤醒。
+class MPSCConsumerWaiter
+{
+public:
+    static constexpr int SpinCount = 1000; // 睡眠前的自旋次数
+
+    // shared 为 true 时对象放在进程间共享内存里，使用共享 futex，见 ShmMPSCQueue.h
+    explicit MPSCConsumerWaiter(bool shared = false) : _waiting(0), _shared(shared) {}
+
+    // 生产者发布元素后调用
+    void Notify()
+    {
+        if (_waiting.load(std::memory_order_seq_cst))
+        {
+            _waiting.store(0, std::memory_order_relaxed);
+            FutexWake(&_waiting, 1, _shared);
+        }
+    }
+
+    // 消费者调用，deadline 为 nullptr 表示一直等待，超时返回 false。
+    // tryDequeue 是不计数的出队，统计在这里记：成功记一次出队，一次等待最多记一次空轮询，自旋和重试不计
+    template<typename TryDequeue, typename IsEmpty>
+    bool Wait(TryDequeue tryDequeue, IsEmpty isEmpty, const std::chrono::steady_clock::time_point* deadline,
+        QueueStats& stats)
+    {
+        if (tryDequeue())
+        {
+            stats.OnDequeue();
+            return true;
+        }
+        stats.OnEmptyPoll();
+
+        int spin = 0;
+        while (!tryDequeue())
+        {
+            if (spin < SpinCount)
+            {
+                ++spin;
+                CpuRelax();
+                continue;
+            }
+
+            // 有生产者已经交换了 _head 但还没链接上，很快就能取到
+            if (!isEmpty())
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            struct timespec ts;
+            struct timespec* timeout = nullptr;
+            if (deadline)
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if (now >= *deadline)
+                    return false;
+
+                long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(*deadline - now).count();
+                ts.tv_sec = ns / 1000000000;
+                ts.tv_nsec = ns % 1000000000;
+                timeout = &ts;
+            }
+
+            _waiting.store(1, std::memory_order_seq_cst);
+            if (isEmpty())
+            {
+                stats.OnBlockedWait();
+                FutexWait(&_waiting, 1, timeout, _shared);
+            }
+            _waiting.store(0, std::memory_order_relaxed);
+            spin = 0;
+        }
+        stats.OnDequeue();
+        return true;
+    }
+
+private:
+    std::atomic<uint32_t> _waiting; // 消费者正在睡眠时为 1
+    bool _shared; // 是否跨进程
+};
+
+// 默认的节点分配器，直接使用全局 new/delete
+// 节点分配器需要提供 void* Allocate() 和 void Deallocate(void*)，
+// Allocate 由生产者调用，Deallocate 只由消费者调用，见 MPSCNodePool.h
+template<typename Node>
+struct MPSCHeapNodeAllocator
+{
+    void* Allocate() { return ::operator new(sizeof(Node)); }
+    void Deallocate(void* p) { ::operator delete(p); }
+};
+
 // 非侵入式多生产者单消费者队列模板类
-template<typename T>
+template<typename T, template<typename> class NodeAllocator = MPSCHeapNodeAllocator>
 class MPSCQueueNonIntrusive
 {
+    struct Node;
+
 public:
     // 构造函数
     MPSCQueueNonIntrusive() 
         // 初始化头指针，创建一个新的节点作为初始头节点
-        : _head(new Node()), 
+        : _head(NewNode(nullptr)), 
         // 初始化尾指针，指向头节点
         _tail(_head.load(std::memory_order_relaxed)) 
     {
@@ -35,40 +141,117 @@ public:
         // 获取头节点
         Node* front = _head.load(std::memory_order_relaxed);
         // 释放头节点的内存
-        delete front;
+        DeleteNode(front);
     }
 
+    // 节点分配器，可用于配置节点池或读取统计
+    NodeAllocator<Node>& GetNodeAllocator() { return _allocator; }
+
     // 入队操作，是无等待的（wait-free）
     void Enqueue(T* input)
     {
         // 创建一个新的节点，存储输入元素
-        Node* node = new Node(input);
+        Node* node = NewNode(input);
+        // 统计，采样到的节点记下入队时间
+        StampNode(node, _stats.OnEnqueue());
         // 原子地交换头指针，返回旧的头指针
-        Node* prevHead = _head.exchange(node, std::memory_order_acq_rel);
+        Node* prevHead = _head.exchange(node, std::memory_order_seq_cst);
         // 将旧头节点的下一个节点指针指向新节点
         prevHead->Next.store(node, std::memory_order_release);
+        // 消费者在睡眠时才唤醒
+        _waiter.Notify();
     }
 
     // 出队操作
     bool Dequeue(T*& result)
     {
-        // 获取尾节点
-        Node* tail = _tail.load(std::memory_order_relaxed);
-        // 获取尾节点的下一个节点
-        Node* next = tail->Next.load(std::memory_order_acquire);
-        // 如果尾节点的下一个节点为空，说明队列为空，返回 false
-        if (!next)
+        if (!TryDequeue(result))
+        {
+            _stats.OnEmptyPoll();
             return false;
+        }
 
-        // 将出队元素赋值给结果指针
-        result = next->Data;
-        // 更新尾指针为下一个节点
-        _tail.store(next, std::memory_order_release);
-        // 释放旧尾节点的内存
-        delete tail;
+        _stats.OnDequeue();
         return true;
     }
 
+    // 批量入队：先在本地把 [first, last) 串成一条私有链，再用一次 exchange 接到队列上
+    template<typename Iterator>
+    void EnqueueBulk(Iterator first, Iterator last)
+    {
+        if (first == last)
+            return;
+
+        // 私有链还未发布，内部链接用 relaxed 写即可，由最后的 release 写发布
+        Node* chainHead = NewNode(*first);
+        Node* chainTail = chainHead;
+        uint64_t count = 1;
+        for (++first; first != last; ++first)
+        {
+            Node* node = NewNode(*first);
+            StampNode(node, false);
+            chainTail->Next.store(node, std::memory_order_relaxed);
+            chainTail = node;
+            ++count;
+        }
+        // 跨过采样点时给整批的第一个节点打时间戳
+        StampNode(chainHead, _stats.OnEnqueue(count));
+
+        Node* prevHead = _head.exchange(chainTail, std::memory_order_seq_cst);
+        prevHead->Next.store(chainHead, std::memory_order_release);
+        _waiter.Notify();
+    }
+
+    // 批量出队：最多取出 max 个元素写入 out，返回实际取出的个数
+    template<typename OutputIterator>
+    size_t DequeueBulk(OutputIterator out, size_t max)
+    {
+        Node* tail = _tail.load(std::memory_order_relaxed);
+        size_t count = 0;
+        while (count < max)
+        {
+            Node* next = tail->Next.load(std::memory_order_acquire);
+            if (!next)
+                break;
+
+            *out++ = next->Data;
+            DeleteNode(tail);
+            TraceNode(next);
+            tail = next;
+            ++count;
+        }
+
+        // 整批只更新一次尾指针
+        if (count)
+        {
+            _tail.store(tail, std::memory_order_release);
+            _stats.OnDequeue(count);
+        }
+        else
+            _stats.OnEmptyPoll();
+        return count;
+    }
+
+    // 队列是否为空（包括没有进行到一半的入队），只能由消费者调用
+    bool Empty() const { return IsEmpty(); }
+
+    // 统计快照，未定义 MARK_QUEUE_STATS 时全为 0
+    QueueStatsSnapshot Stats() const { return _stats.Snapshot(); }
+
+    // 阻塞出队：队列为空时先自旋，再在 futex 上睡眠直到有元素入队
+    void DequeueWait(T*& result)
+    {
+        _waiter.Wait([&]() { return TryDequeue(result); }, [this]() { return IsEmpty(); }, nullptr, _stats);
+    }
+
+    // 带超时的阻塞出队，超时返回 false
+    template<typename Rep, typename Period>
+    bool DequeueWaitFor(T*& result, std::chrono::duration<Rep, Period> const& timeout)
+    {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+        return _waiter.Wait([&]() { return TryDequeue(result); }, [this]() { return IsEmpty(); }, &deadline, _stats);
+    }
+
 private:
     // 队列节点结构体
     struct Node
@@ -84,10 +267,81 @@ private:
 
         T* Data;  // 节点存储的数据指针
         std::atomic<Node*> Next; // 指向下一个节点的原子指针
+#ifdef MARK_QUEUE_STATS
+        uint64_t Stamp; // 采样节点的入队时间，0 表示未采样
+#endif
     };
 
-    std::atomic<Node*> _head; // 队列的头指针，原子类型
-    std::atomic<Node*> _tail; // 队列的尾指针，原子类型
+    // 逗留时间采样：生产者给采样到的节点记下入队时间，消费者出队时计算
+    void StampNode(Node* node, bool sample)
+    {
+#ifdef MARK_QUEUE_STATS
+        node->Stamp = sample ? QueueStats::Now() : 0;
+#else
+        (void)node;
+        (void)sample;
+#endif
+    }
+
+    void TraceNode(Node* node)
+    {
+#ifdef MARK_QUEUE_STATS
+        if (node->Stamp)
+            _stats.OnSojourn(QueueStats::Now() - node->Stamp);
+#else
+        (void)node;
+#endif
+    }
+
+    // 不计出队次数的出队，阻塞等待时反复调用
+    bool TryDequeue(T*& result)
+    {
+        // 获取尾节点
+        Node* tail = _tail.load(std::memory_order_relaxed);
+        // 获取尾节点的下一个节点
+        Node* next = tail->Next.load(std::memory_order_acquire);
+        // 如果尾节点的下一个节点为空，说明队列为空，返回 false
+        if (!next)
+            return false;
+
+        // 将出队元素赋值给结果指针
+        result = next->Data;
+        // 更新尾指针为下一个节点
+        _tail.store(next, std::memory_order_release);
+        // 释放旧尾节点的内存
+        DeleteNode(tail);
+        TraceNode(next);
+        return true;
+    }
+
+    // 队列为空且没有进行到一半的入队，只由消费者调用
+    bool IsEmpty() const
+    {
+        return _head.load(std::memory_order_seq_cst) == _tail.load(std::memory_order_relaxed);
+    }
+
+    // 通过分配器创建节点
+    Node* NewNode(T* data)
+    {
+        return new (_allocator.Allocate()) Node(data);
+    }
+
+    // 析构节点并把内存交还分配器
+    void DeleteNode(Node* node)
+    {
+        node->~Node();
+        _allocator.Deallocate(node);
+    }
+
+    NodeAllocator<Node> _allocator; // 节点分配器，必须在 _head 之前构造
+
+    // 生产者区域：每次入队都会 exchange _head、读 _waiter，消费者只在睡眠前后写 _waiter
+    alignas(CacheLineSize) std::atomic<Node*> _head; // 队列的头指针，原子类型
+    MPSCConsumerWaiter _waiter; // 阻塞出队时的睡眠/唤醒
+
+    // 消费者区域：_tail 只由消费者读写，和 _head 分开，出队不会把生产者的缓存行抢走
+    alignas(CacheLineSize) std::atomic<Node*> _tail; // 队列的尾指针，原子类型
+    QueueStats _stats; // 运行统计，只有定义 MARK_QUEUE_STATS 时才有开销
 
     // 禁用拷贝构造函数
     MPSCQueueNonIntrusive(MPSCQueueNonIntrusive const&) = delete;
@@ -125,17 +379,105 @@ public:
 
     // 入队操作
     void Enqueue(T* input)
+    {
+        Link(input);
+        _stats.OnEnqueue();
+        // 消费者在睡眠时才唤醒
+        _waiter.Notify();
+    }
+
+    // 出队操作
+    bool Dequeue(T*& result)
+    {
+        if (!TryDequeue(result))
+        {
+            _stats.OnEmptyPoll();
+            return false;
+        }
+
+        _stats.OnDequeue();
+        return true;
+    }
+
+    // 批量入队：先把 [first, last) 通过侵入式链接串成私有链，再用一次 exchange 接到队列上
+    template<typename Iterator>
+    void EnqueueBulk(Iterator first, Iterator last)
+    {
+        if (first == last)
+            return;
+
+        T* chainHead = *first;
+        T* chainTail = chainHead;
+        uint64_t count = 1;
+        for (++first; first != last; ++first)
+        {
+            T* input = *first;
+            (chainTail->*IntrusiveLink).store(input, std::memory_order_relaxed);
+            chainTail = input;
+            ++count;
+        }
+        (chainTail->*IntrusiveLink).store(nullptr, std::memory_order_release);
+
+        T* prevHead = _head.exchange(chainTail, std::memory_order_seq_cst);
+        (prevHead->*IntrusiveLink).store(chainHead, std::memory_order_release);
+        _stats.OnEnqueue(count);
+        _waiter.Notify();
+    }
+
+    // 批量出队：最多取出 max 个元素写入 out，返回实际取出的个数
+    // 出队路径本身没有原子读改写（除了偶尔重新入队 dummy），这里逐个调用 TryDequeue 即可，统计整批记一次
+    template<typename OutputIterator>
+    size_t DequeueBulk(OutputIterator out, size_t max)
+    {
+        size_t count = 0;
+        T* result;
+        while (count < max && TryDequeue(result))
+        {
+            *out++ = result;
+            ++count;
+        }
+
+        if (count)
+            _stats.OnDequeue(count);
+        else
+            _stats.OnEmptyPoll();
+        return count;
+    }
+
+    // 队列是否为空（包括没有进行到一半的入队），只能由消费者调用
+    bool Empty() const { return IsEmpty(); }
+
+    // 统计快照，未定义 MARK_QUEUE_STATS 时全为 0
+    QueueStatsSnapshot Stats() const { return _stats.Snapshot(); }
+
+    // 阻塞出队：队列为空时先自旋，再在 futex 上睡眠直到有元素入队
+    void DequeueWait(T*& result)
+    {
+        _waiter.Wait([&]() { return TryDequeue(result); }, [this]() { return IsEmpty(); }, nullptr, _stats);
+    }
+
+    // 带超时的阻塞出队，超时返回 false
+    template<typename Rep, typename Period>
+    bool DequeueWaitFor(T*& result, std::chrono::duration<Rep, Period> const& timeout)
+    {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+        return _waiter.Wait([&]() { return TryDequeue(result); }, [this]() { return IsEmpty(); }, &deadline, _stats);
+    }
+
+private:
+    // 把元素接到队列头部
+    void Link(T* input)
     {
         // 将输入元素的侵入式链接指针初始化为 nullptr
         (input->*IntrusiveLink).store(nullptr, std::memory_order_release);
         // 原子地交换头指针，返回旧的头指针
-        T* prevHead = _head.exchange(input, std::memory_order_acq_rel);
+        T* prevHead = _head.exchange(input, std::memory_order_seq_cst);
         // 将旧头节点的侵入式链接指针指向输入元素
         (prevHead->*IntrusiveLink).store(input, std::memory_order_release);
     }
 
-    // 出队操作
-    bool Dequeue(T*& result)
+    // 不带统计的出队，逻辑见 Dequeue
+    bool TryDequeue(T*& result)
     {
         // 获取尾节点
         T* tail = _tail.load(std::memory_order_relaxed);
@@ -172,7 +514,7 @@ public:
             return false;
 
         // 将 dummy 节点入队
-        Enqueue(_dummyPtr);
+        Link(_dummyPtr);
         // 再次获取尾节点的下一个节点
         next = (tail->*IntrusiveLink).load(std::memory_order_acquire);
         // 如果下一个节点不为空
@@ -187,11 +529,21 @@ public:
         return false;
     }
 
-private:
+    // 队列为空且没有进行到一半的入队：尾和头都停在 dummy 上，只由消费者调用
+    bool IsEmpty() const
+    {
+        return _tail.load(std::memory_order_relaxed) == _dummyPtr && _head.load(std::memory_order_seq_cst) == _dummyPtr;
+    }
+
     std::aligned_storage_t<sizeof(T), alignof(T)> _dummy; // 用于占位的 dummy 对象
     T* _dummyPtr; // 指向 dummy 对象的指针
-    std::atomic<T*> _head; // 队列的头指针，原子类型
-    std::atomic<T*> _tail; // 队列的尾指针，原子类型
+
+    // 生产者区域和消费者区域分别占用独立的缓存行，见 MPSCQueueNonIntrusive
+    alignas(CacheLineSize) std::atomic<T*> _head; // 队列的头指针，原子类型
+    MPSCConsumerWaiter _waiter; // 阻塞出队时的睡眠/唤醒
+
+    alignas(CacheLineSize) std::atomic<T*> _tail; // 队列的尾指针，原子类型
+    QueueStats _stats; // 运行统计（侵入式队列没有地方存时间戳，不采样逗留时间）
 
     // 禁用拷贝构造函数
     MPSCQueueIntrusive(MPSCQueueIntrusive const&) = delete;
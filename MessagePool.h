@@ -0,0 +1,292 @@
+// 跨线程收发的消息对象池
+
+#ifndef _MARK_MESSAGE_POOL_H
+#define _MARK_MESSAGE_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "CacheLine.h"
+#include "MPSCQueue.h"
+
+// 消息在生产者线程上分配、在消费者线程上释放，每条消息都是一次跨线程释放，
+// 通用分配器要把内存还回分配它的线程缓存，时间长了各线程的缓存都会碎片化。
+//
+// 这里每个分配线程有自己的缓存，按 SlabObjects 个对象一块从系统申请 slab，
+// 在 slab 里顺序切出对象。Free 可以在任意线程调用：对象属于本线程时直接放回本地空闲链，
+// 否则析构后用消息自己的 IntrusiveLink 压入所属线程的归还队列（MPSCQueueIntrusive），
+// 一次 exchange 即可，不加锁；所属线程在本地空闲链用完时从归还队列取回对象，
+// 取完了才切新的对象或申请新的 slab。稳定状态下收发消息不再调用 malloc。
+//
+// 对象所属的缓存记在 slab 头部，slab 按 SlabAlign 对齐，由对象地址取整即可找到。
+// 析构后的对象只保留侵入式链接（与 MPSCQueueIntrusive 的 dummy 相同的做法），
+// 所以 T 只需要一个 std::atomic<T*> 成员，msgqueue 的 linkoff 也可以指向它，
+// 消息离开队列后这个链接正好空闲，归还时复用。
+//
+// 线程第一次分配时登记自己的缓存，以后通过线程本地变量直接找到。线程退出后缓存成为孤儿，
+// 之后归还给它的对象没有线程取回：新线程登记时直接接手一个孤儿缓存；
+// 已有的线程要申请新 slab 之前，先把孤儿缓存里空闲和归还的对象都取过来。
+// 孤儿缓存的归还队列只在持有登记表的锁时读取，所以仍然只有一个消费者。
+// 线程本地变量按 T 区分，同一个线程交替使用两个同类型的池时每次切换都要在登记表里查找一次。
+// 池析构时所有对象都应已经 Free，没有归还的对象不会被析构。
+template<typename T, std::atomic<T*> T::* IntrusiveLink, size_t SlabObjects = 256>
+class MessagePool
+{
+    static_assert(SlabObjects > 0, "SlabObjects must be positive");
+
+    struct Cache;
+
+    struct Slab
+    {
+        Cache* Owner;
+        Slab* Next;
+    };
+
+    static constexpr size_t RoundUpPow2(size_t n)
+    {
+        size_t p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    static constexpr size_t SlabHeader = (sizeof(Slab) + alignof(T) - 1) / alignof(T) * alignof(T);
+    static constexpr size_t SlabAlign = RoundUpPow2(SlabHeader + SlabObjects * sizeof(T));
+
+    // 线程退出时置位，缓存和线程本地变量共同持有，池和线程谁先结束都可以
+    typedef std::shared_ptr<std::atomic<bool>> ExitFlag;
+
+    // 每个分配线程一个
+    struct Cache
+    {
+        explicit Cache(ExitFlag exited) : Exited(std::move(exited)) {}
+
+        // 其它线程归还的对象，消费者只有所属线程
+        MPSCQueueIntrusive<T, IntrusiveLink> Returned;
+
+        // 以下只由所属线程访问，所属线程退出后由持有登记表锁的线程访问
+        alignas(CacheLineSize) T* Free = nullptr; // 本线程释放的对象，经 IntrusiveLink 串起来
+        Slab* Slabs = nullptr;                    // 链表头是正在切分的 slab
+        size_t Carved = SlabObjects;              // 当前 slab 已切出的对象数
+
+        ExitFlag Exited; // 所属线程的退出标志，由登记表的锁保护
+    };
+
+    struct LocalEntry
+    {
+        uint64_t Pool = 0; // 池的 id，0 表示空
+        Cache* Owned = nullptr;
+    };
+
+public:
+    MessagePool() : _id(NextId()), _slabs(0) {}
+
+    ~MessagePool()
+    {
+        for (Cache* cache : _caches)
+        {
+            // 归还队列析构时会 delete 剩下的元素，这里先取空
+            T* object;
+            while (cache->Returned.Dequeue(object))
+                ;
+
+            Slab* slab = cache->Slabs;
+            while (slab)
+            {
+                Slab* next = slab->Next;
+                ::operator delete(slab, std::align_val_t(SlabAlign));
+                slab = next;
+            }
+            delete cache;
+        }
+
+        LocalEntry& local = Local();
+        if (local.Pool == _id)
+            local = LocalEntry();
+    }
+
+    // 在池中构造一个对象，在哪个线程调用就从哪个线程的缓存分配
+    template<typename... Args>
+    T* Allocate(Args&&... args)
+    {
+        Cache* cache = LocalCache();
+
+        T* object;
+        if (!PopLocal(cache, object) && !cache->Returned.Dequeue(object))
+        {
+            // 当前 slab 切完了，申请新的之前先把孤儿缓存里的对象取过来
+            if (cache->Carved == SlabObjects)
+                DrainOrphans(cache);
+            if (!PopLocal(cache, object))
+                object = Carve(cache);
+        }
+
+        try
+        {
+            return new (object) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            new (&(object->*IntrusiveLink)) std::atomic<T*>(nullptr);
+            PushLocal(cache, object);
+            throw;
+        }
+    }
+
+    // 析构对象并把内存还给分配它的线程，可以在任意线程调用
+    void Free(T* object)
+    {
+        Cache* owner = SlabOf(object)->Owner;
+        object->~T();
+
+        // 只保留链接，供本地空闲链或归还队列使用
+        new (&(object->*IntrusiveLink)) std::atomic<T*>(nullptr);
+
+        LocalEntry& local = Local();
+        if (local.Pool == _id && local.Owned == owner)
+            PushLocal(owner, object);
+        else
+            owner->Returned.Enqueue(object);
+    }
+
+    // 统计：向系统申请过的 slab 数，每个 slab 放 SlabObjects 个对象
+    uint64_t Slabs() const { return _slabs.load(std::memory_order_relaxed); }
+
+private:
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> id(0);
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    static LocalEntry& Local()
+    {
+        static thread_local LocalEntry local;
+        return local;
+    }
+
+    struct ThreadExit
+    {
+        ExitFlag Flag = std::make_shared<std::atomic<bool>>(false);
+
+        ~ThreadExit() { Flag->store(true, std::memory_order_release); }
+    };
+
+    static const ExitFlag& CurrentThread()
+    {
+        static thread_local ThreadExit exit;
+        return exit.Flag;
+    }
+
+    static Slab* SlabOf(T* object)
+    {
+        return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(object) & ~(uintptr_t)(SlabAlign - 1));
+    }
+
+    static void PushLocal(Cache* cache, T* object)
+    {
+        (object->*IntrusiveLink).store(cache->Free, std::memory_order_relaxed);
+        cache->Free = object;
+    }
+
+    static bool PopLocal(Cache* cache, T*& object)
+    {
+        object = cache->Free;
+        if (!object)
+            return false;
+        cache->Free = (object->*IntrusiveLink).load(std::memory_order_relaxed);
+        return true;
+    }
+
+    Cache* LocalCache()
+    {
+        LocalEntry& local = Local();
+        if (local.Pool == _id)
+            return local.Owned;
+
+        const ExitFlag& self = CurrentThread();
+        std::lock_guard<std::mutex> lock(_mutex);
+        Cache* cache = nullptr;
+        for (Cache* c : _caches)
+        {
+            if (c->Exited == self)
+            {
+                cache = c;
+                break;
+            }
+        }
+        if (!cache)
+        {
+            // 接手一个孤儿缓存，连同它的 slab 和归还队列
+            for (Cache* c : _caches)
+            {
+                if (c->Exited->load(std::memory_order_acquire))
+                {
+                    c->Exited = self;
+                    cache = c;
+                    break;
+                }
+            }
+        }
+        if (!cache)
+        {
+            cache = new Cache(self);
+            _caches.push_back(cache);
+        }
+
+        local.Pool = _id;
+        local.Owned = cache;
+        return cache;
+    }
+
+    // 把孤儿缓存的空闲链和归还队列全部移到 cache 的空闲链。
+    // 这些对象的 slab 仍属于孤儿，以后释放时回到孤儿的归还队列，再被取过来
+    void DrainOrphans(Cache* cache)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (Cache* c : _caches)
+        {
+            if (c == cache || !c->Exited->load(std::memory_order_acquire))
+                continue;
+
+            T* object;
+            while (PopLocal(c, object))
+                PushLocal(cache, object);
+            while (c->Returned.Dequeue(object))
+                PushLocal(cache, object);
+        }
+    }
+
+    T* Carve(Cache* cache)
+    {
+        if (cache->Carved == SlabObjects)
+        {
+            Slab* slab = static_cast<Slab*>(::operator new(SlabAlign, std::align_val_t(SlabAlign)));
+            slab->Owner = cache;
+            slab->Next = cache->Slabs;
+            cache->Slabs = slab;
+            cache->Carved = 0;
+            _slabs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        char* base = reinterpret_cast<char*>(cache->Slabs) + SlabHeader;
+        return reinterpret_cast<T*>(base) + cache->Carved++;
+    }
+
+    const uint64_t _id;
+    std::atomic<uint64_t> _slabs;
+
+    std::mutex _mutex; // 保护登记表，只在线程第一次使用池时加锁
+    std::vector<Cache*> _caches;
+
+    MessagePool(MessagePool const&) = delete;
+    MessagePool& operator=(MessagePool const&) = delete;
+};
+
+#endif
@@ -3,28 +3,53 @@
 #ifndef _MARK_PC_QUEUE_H
 #define _MARK_PC_QUEUE_H
 
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
 #include <mutex>
 #include <queue>
 #include <atomic>
+#include <utility>
 #include <type_traits>   //是 C++ 标准库中的头文件，其中包含了许多用于类型特性检查和转换的模板类
 
+#include "QueueStats.h"
+
+//入队时只有确实有消费者在等待才发起通知，而且通知放在解锁之后，
+//被唤醒的消费者不会一醒来就又阻塞在生产者还没释放的锁上。
+//消费者可以用 PopAll 一次把整个容器换出来，锁内只有一次交换，之后在锁外逐个处理。
 template <typename T>
 class ProducerConsumerQueue{
 private:
     std::mutex _queueLock;
     std::queue<T> _queue;
     std::condition_variable _condition;
-    std::atomic<boo> _shutdown;
+    size_t _waiters;                 //正在等待的消费者个数，由 _queueLock 保护
+    std::atomic<size_t> _size;       //元素个数，在锁内更新，Size() 不加锁读取
+    std::atomic<bool> _shutdown;
+    QueueStats _stats;   //运行统计，只有定义 MARK_QUEUE_STATS 时才有开销
 
 public:
-    ProducerConsumerQueue<T>() : _shutdown(false){}
+    ProducerConsumerQueue() : _waiters(0), _size(0), _shutdown(false){}
 
-    void Push(const T& value){
-        std::lock_guard<std::mutex> lock(_queueLock);
-        _queue.push(std::move(value));
+    void Push(const T& value){ Emplace(value); }
+
+    //右值版本，锁内只做移动
+    void Push(T&& value){ Emplace(std::move(value)); }
 
-        _condition.notify_one();
+    //在队列中直接构造元素
+    template<typename... Args>
+    void Emplace(Args&&... args){
+        bool notify;
+        {
+            std::lock_guard<std::mutex> lock(_queueLock);
+            QueueStats::HoldTimer hold(_stats);
+            _queue.emplace(std::forward<Args>(args)...);
+            OnPush();
+            notify = _waiters != 0;
+        }
+
+        if (notify)
+            _condition.notify_one();
     }
 
     bool Empty(){
@@ -33,59 +58,189 @@ public:
         return _queue.empty();
     }
 
+    //近似的元素个数，不加锁，可能落后于正在进行的入队和出队
     size_t Size() const
     {
-        return _queue.size();
+        return _size.load(std::memory_order_relaxed);
     }
 
     bool Pop(T& value)
     {
         std::lock_guard<std::mutex> lock(_queueLock);
+        QueueStats::HoldTimer hold(_stats);
 
         if (_queue.empty() || _shutdown)
+        {
+            _stats.OnEmptyPoll();
             return false;
+        }
 
-        value = _queue.front();
+        value = std::move(_queue.front());
 
         _queue.pop();
+        OnPop();
 
         return true;
     }
 
+    //取走全部元素：把内部容器和 values 交换，values 原有的内容被丢弃。
+    //传入处理完的空容器时，它会换进队列继续使用，不需要重新分配。
+    //返回取到的个数，队列为空或已取消时返回 0
+    size_t PopAll(std::queue<T>& values)
+    {
+        if (!values.empty())
+            std::queue<T>().swap(values);
+        {
+            std::lock_guard<std::mutex> lock(_queueLock);
+            QueueStats::HoldTimer hold(_stats);
+
+            if (_queue.empty() || _shutdown)
+            {
+                _stats.OnEmptyPoll();
+                return 0;
+            }
+
+            _queue.swap(values);
+            OnPopAll(values.size());
+        }
+        //旧容器在锁外析构
+        return values.size();
+    }
+
     //没产品就阻塞，有产品被唤醒
     void WaitAndPop(T& value)
     {
         std::unique_lock<std::mutex> lock(_queueLock);
 
-        while (_queue.empty() && !_shutdown)
-            _condition.wait(lock);
+        Wait(lock);
 
         if (_queue.empty() || _shutdown)
             return;
 
-        value = _queue.front();
+        value = std::move(_queue.front());
 
         _queue.pop();
+        OnPop();
     }
 
-    void Cancel()
+    //阻塞直到有元素，然后取走全部元素，队列已取消时返回 0
+    size_t WaitAndPopAll(std::queue<T>& values)
+    {
+        if (!values.empty())
+            std::queue<T>().swap(values);
+        {
+            std::unique_lock<std::mutex> lock(_queueLock);
+
+            Wait(lock);
+
+            if (_queue.empty() || _shutdown)
+                return 0;
+
+            _queue.swap(values);
+            OnPopAll(values.size());
+        }
+        return values.size();
+    }
+
+    //带超时的等待，在 deadline 之前取到元素返回 true，超时或队列已取消返回 false
+    template<typename Clock, typename Duration>
+    bool WaitAndPopUntil(T& value, std::chrono::time_point<Clock, Duration> const& deadline)
     {
         std::unique_lock<std::mutex> lock(_queueLock);
 
-        while (!_queue.empty())
+        if (_queue.empty() && !_shutdown)
         {
-            T& value = _queue.front();
+            _stats.OnBlockedWait();
+            ++_waiters;
+            while (_queue.empty() && !_shutdown)
+                if (_condition.wait_until(lock, deadline) == std::cv_status::timeout)
+                    break;
+            --_waiters;
+        }
 
-            DeleteQueuedObject(value);
+        if (_queue.empty() || _shutdown)
+            return false;
 
-            _queue.pop();
-        }
+        value = std::move(_queue.front());
 
-        _shutdown = true;
+        _queue.pop();
+        OnPop();
+
+        return true;
+    }
+
+    //按单调时钟计算截止时间，不受系统时间调整影响
+    template<typename Rep, typename Period>
+    bool WaitAndPopFor(T& value, std::chrono::duration<Rep, Period> const& timeout)
+    {
+        return WaitAndPopUntil(value, std::chrono::steady_clock::now() + timeout);
+    }
+
+    void Cancel()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_queueLock);
+
+            //丢弃的元素按出队计，入队和出队的计数保持配对
+            size_t count = _queue.size();
+            while (!_queue.empty())
+            {
+                T& value = _queue.front();
+
+                DeleteQueuedObject(value);
+
+                _queue.pop();
+            }
+
+            OnPopAll(count);
+            _shutdown = true;
+        }
 
         _condition.notify_all();
     }
+    //统计快照，未定义 MARK_QUEUE_STATS 时全为 0
+    QueueStatsSnapshot Stats() const
+    {
+        return _stats.Snapshot();
+    }
+
 private:
+    //以下函数在持有锁时调用
+    void Wait(std::unique_lock<std::mutex>& lock)
+    {
+        if (!_queue.empty() || _shutdown)
+            return;
+
+        _stats.OnBlockedWait();
+        ++_waiters;
+        while (_queue.empty() && !_shutdown)
+            _condition.wait(lock);
+        --_waiters;
+    }
+
+    void OnPush()
+    {
+        _size.store(_queue.size(), std::memory_order_relaxed);
+        _stats.OnEnqueue();
+        _stats.OnDepth(_queue.size());
+        _stats.TracePush();
+    }
+
+    void OnPop()
+    {
+        _size.store(_queue.size(), std::memory_order_relaxed);
+        _stats.OnDequeue();
+        _stats.TracePop();
+    }
+
+    void OnPopAll(size_t count)
+    {
+        _size.store(0, std::memory_order_relaxed);
+        _stats.OnDequeue(count);
+        for (size_t i = 0; i < count; ++i)
+            _stats.TracePop();
+    }
+
     template<typename E = T>
     typename std::enable_if<std::is_pointer<E>::value>::type DeleteQueuedObject(E& obj) { delete obj; }
 
@@ -94,4 +249,4 @@ private:
 
 };
 
-#endif
\ No newline at end of file
+#endif
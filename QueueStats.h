@@ -0,0 +1,247 @@
+// 队列运行统计：入队/出队次数、深度高水位、阻塞等待、空轮询、采样的逗留时间和锁持有时间
+//
+// 编译时定义 MARK_QUEUE_STATS 才会统计，否则 QueueStats 是空类，所有调用都会被内联掉。
+// 计数器按线程编号分散到多个按缓存行对齐的分片上，各线程基本只写自己的分片，
+// 读取快照时再把所有分片加起来，所以开启统计时热路径上也没有共享的写。
+
+#ifndef _MARK_QUEUE_STATS_H
+#define _MARK_QUEUE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "CacheLine.h"
+
+// 导出给监控系统的统计快照
+struct QueueStatsSnapshot
+{
+    uint64_t Enqueues = 0;
+    uint64_t Dequeues = 0;
+    uint64_t Depth = 0;           // 快照时的近似深度
+    uint64_t HighWater = 0;       // 采样得到的深度高水位
+    uint64_t BlockedWaits = 0;    // 因队列空/满而阻塞的次数
+    uint64_t EmptyPolls = 0;      // 出队时发现队列为空的次数
+    uint64_t SojournSamples = 0;  // 逗留时间（入队到出队）采样
+    uint64_t SojournTotalNs = 0;
+    uint64_t SojournMaxNs = 0;
+    uint64_t LockHoldSamples = 0; // 锁持有时间采样
+    uint64_t LockHoldTotalNs = 0;
+    uint64_t LockHoldMaxNs = 0;
+};
+
+#ifdef MARK_QUEUE_STATS
+
+class QueueStats
+{
+public:
+    static constexpr bool Enabled = true;
+    static constexpr uint64_t SampleEvery = 64; // 每个分片每 SampleEvery 次操作采样一次
+
+    QueueStats() : _highWater(0), _pushSeq(0), _popSeq(0), _traceSeq(0), _traceStamp(0) {}
+
+    static uint64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 返回 true 表示这批入队跨过了采样点，调用方可以给其中一个元素打时间戳
+    bool OnEnqueue(uint64_t count = 1)
+    {
+        Counters& shard = Shard();
+        uint64_t n = shard.Enqueues.fetch_add(count, std::memory_order_relaxed) + count;
+        if (n / SampleEvery == (n - count) / SampleEvery)
+            return false;
+
+        OnDepth(Sum(&Counters::Enqueues) - Sum(&Counters::Dequeues));
+        return true;
+    }
+
+    void OnDequeue(uint64_t count = 1) { Shard().Dequeues.fetch_add(count, std::memory_order_relaxed); }
+    void OnBlockedWait() { Shard().BlockedWaits.fetch_add(1, std::memory_order_relaxed); }
+    void OnEmptyPoll() { Shard().EmptyPolls.fetch_add(1, std::memory_order_relaxed); }
+
+    // 知道确切深度的队列可以直接上报
+    void OnDepth(uint64_t depth)
+    {
+        if (static_cast<int64_t>(depth) < 0)
+            return;
+
+        uint64_t high = _highWater.load(std::memory_order_relaxed);
+        while (depth > high && !_highWater.compare_exchange_weak(high, depth, std::memory_order_relaxed))
+            ;
+    }
+
+    void OnSojourn(uint64_t ns)
+    {
+        Counters& shard = Shard();
+        shard.SojournSamples.fetch_add(1, std::memory_order_relaxed);
+        shard.SojournTotalNs.fetch_add(ns, std::memory_order_relaxed);
+        Max(shard.SojournMaxNs, ns);
+    }
+
+    void OnLockHold(uint64_t ns)
+    {
+        Counters& shard = Shard();
+        shard.LockHoldSamples.fetch_add(1, std::memory_order_relaxed);
+        shard.LockHoldTotalNs.fetch_add(ns, std::memory_order_relaxed);
+        Max(shard.LockHoldMaxNs, ns);
+    }
+
+    // 本线程这次操作是否需要采样
+    bool ShouldSample()
+    {
+        return Shard().Ticks.fetch_add(1, std::memory_order_relaxed) % SampleEvery == 0;
+    }
+
+    // 先进先出队列的逗留时间采样：TracePush 在入队一侧的锁内调用，TracePop 在出队一侧的锁内调用，
+    // 按入队序号和出队序号配对，同一时刻只跟踪一条消息，不需要在元素上附加时间戳
+    void TracePush()
+    {
+        uint64_t seq = ++_pushSeq;
+        if (seq % SampleEvery == 0 && _traceSeq.load(std::memory_order_acquire) == 0)
+        {
+            _traceStamp = Now();
+            _traceSeq.store(seq, std::memory_order_release);
+        }
+    }
+
+    void TracePop()
+    {
+        uint64_t seq = ++_popSeq;
+        uint64_t trace = _traceSeq.load(std::memory_order_acquire);
+        if (trace && seq >= trace)
+        {
+            OnSojourn(Now() - _traceStamp);
+            _traceSeq.store(0, std::memory_order_release);
+        }
+    }
+
+    // 采样一段锁持有时间：在拿到锁之后构造，在释放锁之前析构
+    class HoldTimer
+    {
+    public:
+        explicit HoldTimer(QueueStats& stats) : _stats(stats), _start(stats.ShouldSample() ? Now() : 0) {}
+        ~HoldTimer()
+        {
+            if (_start)
+                _stats.OnLockHold(Now() - _start);
+        }
+
+    private:
+        QueueStats& _stats;
+        uint64_t _start;
+    };
+
+    QueueStatsSnapshot Snapshot() const
+    {
+        QueueStatsSnapshot snapshot;
+        snapshot.Enqueues = Sum(&Counters::Enqueues);
+        snapshot.Dequeues = Sum(&Counters::Dequeues);
+        snapshot.Depth = snapshot.Enqueues > snapshot.Dequeues ? snapshot.Enqueues - snapshot.Dequeues : 0;
+        snapshot.HighWater = _highWater.load(std::memory_order_relaxed);
+        if (snapshot.HighWater < snapshot.Depth)
+            snapshot.HighWater = snapshot.Depth;
+        snapshot.BlockedWaits = Sum(&Counters::BlockedWaits);
+        snapshot.EmptyPolls = Sum(&Counters::EmptyPolls);
+        snapshot.SojournSamples = Sum(&Counters::SojournSamples);
+        snapshot.SojournTotalNs = Sum(&Counters::SojournTotalNs);
+        snapshot.LockHoldSamples = Sum(&Counters::LockHoldSamples);
+        snapshot.LockHoldTotalNs = Sum(&Counters::LockHoldTotalNs);
+        for (const Counters& shard : _shards)
+        {
+            uint64_t sojourn = shard.SojournMaxNs.load(std::memory_order_relaxed);
+            uint64_t hold = shard.LockHoldMaxNs.load(std::memory_order_relaxed);
+            if (sojourn > snapshot.SojournMaxNs)
+                snapshot.SojournMaxNs = sojourn;
+            if (hold > snapshot.LockHoldMaxNs)
+                snapshot.LockHoldMaxNs = hold;
+        }
+        return snapshot;
+    }
+
+private:
+    static constexpr size_t ShardCount = 32;
+
+    struct alignas(CacheLineSize) Counters
+    {
+        std::atomic<uint64_t> Enqueues{0};
+        std::atomic<uint64_t> Dequeues{0};
+        std::atomic<uint64_t> BlockedWaits{0};
+        std::atomic<uint64_t> EmptyPolls{0};
+        std::atomic<uint64_t> Ticks{0};
+        std::atomic<uint64_t> SojournSamples{0};
+        std::atomic<uint64_t> SojournTotalNs{0};
+        std::atomic<uint64_t> SojournMaxNs{0};
+        std::atomic<uint64_t> LockHoldSamples{0};
+        std::atomic<uint64_t> LockHoldTotalNs{0};
+        std::atomic<uint64_t> LockHoldMaxNs{0};
+    };
+
+    static void Max(std::atomic<uint64_t>& target, uint64_t value)
+    {
+        uint64_t current = target.load(std::memory_order_relaxed);
+        while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+            ;
+    }
+
+    // 进程内每个线程一个固定编号，决定它写哪个分片
+    Counters& Shard()
+    {
+        static std::atomic<size_t> counter(0);
+        static thread_local size_t index = counter.fetch_add(1, std::memory_order_relaxed);
+        return _shards[index % ShardCount];
+    }
+
+    uint64_t Sum(std::atomic<uint64_t> Counters::* field) const
+    {
+        uint64_t sum = 0;
+        for (const Counters& shard : _shards)
+            sum += (shard.*field).load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    Counters _shards[ShardCount];
+    alignas(CacheLineSize) std::atomic<uint64_t> _highWater;
+
+    // 逗留时间跟踪，_pushSeq/_popSeq 分别只在入队/出队一侧的锁内访问
+    alignas(CacheLineSize) uint64_t _pushSeq;
+    alignas(CacheLineSize) uint64_t _popSeq;
+    std::atomic<uint64_t> _traceSeq; // 正在跟踪的入队序号，0 表示没有
+    uint64_t _traceStamp;
+};
+
+#else
+
+// 未开启统计时的空实现
+class QueueStats
+{
+public:
+    static constexpr bool Enabled = false;
+
+    static uint64_t Now() { return 0; }
+    bool OnEnqueue(uint64_t = 1) { return false; }
+    void OnDequeue(uint64_t = 1) {}
+    void OnBlockedWait() {}
+    void OnEmptyPoll() {}
+    void OnDepth(uint64_t) {}
+    void OnSojourn(uint64_t) {}
+    void OnLockHold(uint64_t) {}
+    bool ShouldSample() { return false; }
+    void TracePush() {}
+    void TracePop() {}
+
+    class HoldTimer
+    {
+    public:
+        explicit HoldTimer(QueueStats&) {}
+    };
+
+    QueueStatsSnapshot Snapshot() const { return QueueStatsSnapshot(); }
+};
+
+#endif
+
+#endif
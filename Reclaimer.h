@@ -0,0 +1,382 @@
+// 无锁数据结构的安全内存回收：危险指针和基于 epoch 的回收
+
+#ifndef _MARK_RECLAIMER_H
+#define _MARK_RECLAIMER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "CacheLine.h"
+
+// 无锁链表结构里，一个线程把节点摘下来时，别的线程可能刚读到它的指针、还没来得及访问，
+// 直接释放就是 use-after-free；节点被复用后又回到原来的位置，还会让对方的 CAS 误以为
+// 什么都没变（ABA）。回收域把摘下的节点先“退休”，确认没有线程还能访问它之后，
+// 才交给构造时给出的 dispose 回调（通常是放回节点池）。
+//
+// 两种回收域的接口相同，LinkedMPMCQueue 通过模板参数选择：
+//   typename Domain::Guard guard(domain);         一次操作期间持有
+//   T* p = guard.Protect(slot, atomicPointer);    读取一个要解引用的共享指针
+//   guard.Retire(p);                              p 已经摘下，安全后交给 dispose
+//
+// 每个域维护一组线程记录（只增不减），Guard 构造时占用一条空闲记录、析构时归还，
+// 线程本地变量记住上次用的记录，通常一次 exchange 就能拿到。
+// 退休链表跟着记录走，所以线程退出不会丢下什么，域析构时处理掉所有还没回收的节点。
+// 析构时不能再有并发访问。
+
+// 危险指针（Michael 2004）：每条记录有 Slots 个槽位，Protect 把指针写进槽位后
+// 再确认源位置没变，之后节点不会被回收；退休的节点攒够一批时扫描所有槽位，
+// 不在任何槽位里的交给 dispose。未回收的节点数有上界，停住的线程最多拖住 Slots 个节点。
+template<int Slots = 2>
+class HazardPointerDomain
+{
+    struct alignas(CacheLineSize) Record
+    {
+        std::atomic<void*> Hazards[Slots];
+        std::atomic<bool> Active;
+        Record* Next;
+        std::vector<void*> Retired;  // 只由占用记录的线程访问
+        std::vector<void*> Scratch;  // 扫描时收集的危险指针
+
+        Record() : Active(true), Next(nullptr)
+        {
+            for (int i = 0; i < Slots; ++i)
+                Hazards[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+public:
+    typedef void (*Dispose)(void* context, void* p);
+
+    HazardPointerDomain(Dispose dispose, void* context)
+        : _id(NextId()), _dispose(dispose), _context(context), _records(nullptr), _count(0)
+    {
+    }
+
+    ~HazardPointerDomain()
+    {
+        Record* record = _records.load(std::memory_order_acquire);
+        while (record)
+        {
+            Record* next = record->Next;
+            for (void* p : record->Retired)
+                _dispose(_context, p);
+            delete record;
+            record = next;
+        }
+    }
+
+    class Guard
+    {
+    public:
+        explicit Guard(HazardPointerDomain& domain) : _domain(domain), _record(domain.Acquire()) {}
+
+        ~Guard()
+        {
+            for (int i = 0; i < Slots; ++i)
+                _record->Hazards[i].store(nullptr, std::memory_order_release);
+            _record->Active.store(false, std::memory_order_release);
+        }
+
+        // 发布后重读确认，保证回收方扫描时要么看到槽位，要么节点还没摘下
+        template<typename T>
+        T* Protect(int slot, const std::atomic<T*>& src)
+        {
+            T* p = src.load(std::memory_order_acquire);
+            for (;;)
+            {
+                _record->Hazards[slot].store(p, std::memory_order_seq_cst);
+                T* q = src.load(std::memory_order_seq_cst);
+                if (q == p)
+                    return p;
+                p = q;
+            }
+        }
+
+        void Retire(void* p)
+        {
+            _record->Retired.push_back(p);
+            if (_record->Retired.size() >= _domain.Threshold())
+                _domain.Scan(_record);
+        }
+
+    private:
+        HazardPointerDomain& _domain;
+        Record* _record;
+
+        Guard(Guard const&) = delete;
+        Guard& operator=(Guard const&) = delete;
+    };
+
+private:
+    struct LocalHint
+    {
+        uint64_t Domain = 0;
+        Record* Owned = nullptr;
+    };
+
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> id(0);
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    static LocalHint& Hint()
+    {
+        static thread_local LocalHint hint;
+        return hint;
+    }
+
+    static bool TryTake(Record* record)
+    {
+        return !record->Active.load(std::memory_order_relaxed) &&
+            !record->Active.exchange(true, std::memory_order_acquire);
+    }
+
+    Record* Acquire()
+    {
+        LocalHint& hint = Hint();
+        if (hint.Domain == _id && TryTake(hint.Owned))
+            return hint.Owned;
+
+        Record* record = _records.load(std::memory_order_acquire);
+        for (; record; record = record->Next)
+        {
+            if (TryTake(record))
+                break;
+        }
+
+        if (!record)
+        {
+            record = new Record();
+            Record* head = _records.load(std::memory_order_relaxed);
+            do
+                record->Next = head;
+            while (!_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+            _count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        hint.Domain = _id;
+        hint.Owned = record;
+        return record;
+    }
+
+    // 扫描的代价与槽位总数成正比，攒到槽位总数的两倍再扫，每个退休节点摊到常数时间
+    size_t Threshold() const
+    {
+        size_t threshold = 2 * Slots * _count.load(std::memory_order_relaxed);
+        return threshold < 64 ? 64 : threshold;
+    }
+
+    void Scan(Record* owner)
+    {
+        std::vector<void*>& hazards = owner->Scratch;
+        hazards.clear();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (Record* record = _records.load(std::memory_order_acquire); record; record = record->Next)
+        {
+            for (int i = 0; i < Slots; ++i)
+            {
+                void* p = record->Hazards[i].load(std::memory_order_seq_cst);
+                if (p)
+                    hazards.push_back(p);
+            }
+        }
+        std::sort(hazards.begin(), hazards.end());
+
+        size_t kept = 0;
+        for (void* p : owner->Retired)
+        {
+            if (std::binary_search(hazards.begin(), hazards.end(), p))
+                owner->Retired[kept++] = p;
+            else
+                _dispose(_context, p);
+        }
+        owner->Retired.resize(kept);
+    }
+
+    const uint64_t _id;
+    const Dispose _dispose;
+    void* const _context;
+    std::atomic<Record*> _records;
+    std::atomic<size_t> _count;
+
+    HazardPointerDomain(HazardPointerDomain const&) = delete;
+    HazardPointerDomain& operator=(HazardPointerDomain const&) = delete;
+};
+
+// 基于 epoch 的回收（Fraser 2004）：Guard 构造时宣布自己处在当前全局 epoch，
+// Protect 只是普通读取。节点退休时记下全局 epoch e，全局 epoch 推进到 e + 2 时，
+// 所有在 e 或更早开始的操作都已经结束，节点可以回收。只有所有进行中的操作都处在
+// 当前 epoch 时全局 epoch 才能推进，所以一个停在操作中间的线程会让回收整体停下，
+// 换来的是每次读取指针不需要额外的写和屏障。
+class EpochDomain
+{
+    struct alignas(CacheLineSize) Record
+    {
+        std::atomic<uint64_t> Epoch;  // 操作进行中为 epoch * 2 + 1，空闲为 0
+        std::atomic<bool> Active;
+        Record* Next;
+        std::vector<std::pair<uint64_t, void*>> Retired;  // 只由占用记录的线程访问
+        size_t CollectAt;  // 退休链表长到这么长时尝试回收
+
+        Record() : Epoch(0), Active(true), Next(nullptr), CollectAt(Threshold) {}
+    };
+
+public:
+    typedef void (*Dispose)(void* context, void* p);
+
+    // 每条记录新攒够这么多退休节点才尝试推进一次；推进不了时不会每次退休都重新扫描
+    static constexpr size_t Threshold = 64;
+
+    EpochDomain(Dispose dispose, void* context)
+        : _id(NextId()), _dispose(dispose), _context(context), _epoch(1), _records(nullptr)
+    {
+    }
+
+    ~EpochDomain()
+    {
+        Record* record = _records.load(std::memory_order_acquire);
+        while (record)
+        {
+            Record* next = record->Next;
+            for (auto& retired : record->Retired)
+                _dispose(_context, retired.second);
+            delete record;
+            record = next;
+        }
+    }
+
+    class Guard
+    {
+    public:
+        explicit Guard(EpochDomain& domain) : _domain(domain), _record(domain.Acquire())
+        {
+            // 宣布之后的读取不能越过这次写，否则推进方可能看不到本线程
+            _record->Epoch.store(domain._epoch.load(std::memory_order_relaxed) * 2 + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        ~Guard()
+        {
+            _record->Epoch.store(0, std::memory_order_release);
+            _record->Active.store(false, std::memory_order_release);
+        }
+
+        template<typename T>
+        T* Protect(int, const std::atomic<T*>& src)
+        {
+            return src.load(std::memory_order_acquire);
+        }
+
+        void Retire(void* p)
+        {
+            // 摘下之后读取的全局 epoch 不小于任何可能还拿着 p 的操作所宣布的 epoch
+            _record->Retired.emplace_back(_domain._epoch.load(std::memory_order_seq_cst), p);
+            if (_record->Retired.size() >= _record->CollectAt)
+                _domain.Collect(_record);
+        }
+
+    private:
+        EpochDomain& _domain;
+        Record* _record;
+
+        Guard(Guard const&) = delete;
+        Guard& operator=(Guard const&) = delete;
+    };
+
+private:
+    struct LocalHint
+    {
+        uint64_t Domain = 0;
+        Record* Owned = nullptr;
+    };
+
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> id(0);
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    static LocalHint& Hint()
+    {
+        static thread_local LocalHint hint;
+        return hint;
+    }
+
+    static bool TryTake(Record* record)
+    {
+        return !record->Active.load(std::memory_order_relaxed) &&
+            !record->Active.exchange(true, std::memory_order_acquire);
+    }
+
+    Record* Acquire()
+    {
+        LocalHint& hint = Hint();
+        if (hint.Domain == _id && TryTake(hint.Owned))
+            return hint.Owned;
+
+        Record* record = _records.load(std::memory_order_acquire);
+        for (; record; record = record->Next)
+        {
+            if (TryTake(record))
+                break;
+        }
+
+        if (!record)
+        {
+            record = new Record();
+            Record* head = _records.load(std::memory_order_relaxed);
+            do
+                record->Next = head;
+            while (!_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        hint.Domain = _id;
+        hint.Owned = record;
+        return record;
+    }
+
+    // 所有进行中的操作都在当前 epoch 时推进一步，然后回收本记录里已经安全的节点
+    void Collect(Record* owner)
+    {
+        uint64_t epoch = _epoch.load(std::memory_order_seq_cst);
+        bool advance = true;
+        for (Record* record = _records.load(std::memory_order_acquire); record; record = record->Next)
+        {
+            uint64_t e = record->Epoch.load(std::memory_order_seq_cst);
+            if ((e & 1) && (e >> 1) != epoch)
+            {
+                advance = false;
+                break;
+            }
+        }
+        if (advance && _epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst))
+            ++epoch;
+
+        size_t kept = 0;
+        for (auto& retired : owner->Retired)
+        {
+            if (retired.first + 2 <= epoch)
+                _dispose(_context, retired.second);
+            else
+                owner->Retired[kept++] = retired;
+        }
+        owner->Retired.resize(kept);
+        owner->CollectAt = kept + Threshold;
+    }
+
+    const uint64_t _id;
+    const Dispose _dispose;
+    void* const _context;
+    alignas(CacheLineSize) std::atomic<uint64_t> _epoch;
+    std::atomic<Record*> _records;
+
+    EpochDomain(EpochDomain const&) = delete;
+    EpochDomain& operator=(EpochDomain const&) = delete;
+};
+
+#endif
@@ -0,0 +1,118 @@
+// 单生产者单消费者的无锁有界环形队列
+
+#ifndef _MARK_SPSC_QUEUE_H
+#define _MARK_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "CacheLine.h"
+
+// 元素按值存放在容量为 2 的幂的环形数组中，下标用掩码取模。
+// _head 只由生产者写、_tail 只由消费者写，两者分别放在独立的缓存行上；
+// 生产者缓存一份 _tail、消费者缓存一份 _head，只有缓存值显示队列满/空时才去读对方的下标，
+// 这样大部分操作不会引起缓存行在两个核之间来回传递。
+template<typename T>
+class SPSCQueue
+{
+public:
+    // capacity 会向上取整到 2 的幂
+    explicit SPSCQueue(size_t capacity)
+        : _capacity(RoundUp(capacity)), _mask(_capacity - 1),
+        _slots(static_cast<Slot*>(::operator new(sizeof(Slot) * _capacity))),
+        _head(0), _cachedTail(0), _tail(0), _cachedHead(0)
+    {
+    }
+
+    ~SPSCQueue()
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t head = _head.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail)
+            Element(tail)->~T();
+        ::operator delete(_slots);
+    }
+
+    // 入队，队列满时返回 false，只能由生产者调用
+    bool Enqueue(const T& input) { return Emplace(input); }
+    bool Enqueue(T&& input) { return Emplace(std::move(input)); }
+
+    template<typename... Args>
+    bool Emplace(Args&&... args)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _cachedTail == _capacity)
+        {
+            // 缓存的 _tail 显示已满，重新读取消费者的真实进度
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head - _cachedTail == _capacity)
+                return false;
+        }
+
+        new (&_slots[head & _mask]) T(std::forward<Args>(args)...);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 出队，队列空时返回 false，只能由消费者调用
+    bool Dequeue(T& result)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _cachedHead)
+        {
+            // 缓存的 _head 显示为空，重新读取生产者的真实进度
+            _cachedHead = _head.load(std::memory_order_acquire);
+            if (tail == _cachedHead)
+                return false;
+        }
+
+        T* element = Element(tail);
+        result = std::move(*element);
+        element->~T();
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 近似的元素个数，只在单线程或调试时准确
+    size_t Size() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const { return _capacity; }
+
+private:
+    typedef std::aligned_storage_t<sizeof(T), alignof(T)> Slot;
+
+    static size_t RoundUp(size_t n)
+    {
+        size_t capacity = 1;
+        while (capacity < n)
+            capacity <<= 1;
+        return capacity;
+    }
+
+    T* Element(size_t index) { return reinterpret_cast<T*>(&_slots[index & _mask]); }
+
+    const size_t _capacity;
+    const size_t _mask;
+    Slot* const _slots;
+
+    // 生产者独占的缓存行
+    alignas(CacheLineSize) std::atomic<size_t> _head; // 下一个写入位置
+    size_t _cachedTail;                    // 生产者看到的 _tail
+
+    // 消费者独占的缓存行
+    alignas(CacheLineSize) std::atomic<size_t> _tail; // 下一个读取位置
+    size_t _cachedHead;                    // 消费者看到的 _head
+
+    // 禁用拷贝构造函数
+    SPSCQueue(SPSCQueue const&) = delete;
+    // 禁用赋值运算符
+    SPSCQueue& operator=(SPSCQueue const&) = delete;
+};
+
+#endif
@@ -0,0 +1,223 @@
+// 分段数组存储的无界多生产者单消费者队列
+
+#ifndef _MARK_SEGMENTED_MPSC_QUEUE_H
+#define _MARK_SEGMENTED_MPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "CacheLine.h"
+#include "MPSCQueue.h"
+#include "QueueStats.h"
+
+// 元素按值存放在定长的段里，段与段之间用链表连接，每 SegmentSize 个元素才分配一次内存，
+// 消费者在段内顺序读取，访问模式对预取友好，不再每条消息追一次指针。
+//
+// 生产者的尾部是一个 64 位字：高位是当前尾段的地址（段按 SegmentAlign 对齐，低位恒为 0），
+// 低 IndexBits 位是段内已经领取的槽位数。生产者对这个字做一次 fetch_add，
+// 同时拿到段地址和槽位下标，所以不会出现"读到段指针之后段被回收"的问题：
+//   下标 < SegmentSize：槽位属于自己，写入元素后置 Ready，这个段在 Ready 之前不可能被回收；
+//   下标 == SegmentSize：段已满，由这个生产者负责挂上下一段并把尾部字换成新段，自己占新段的 0 号槽位；
+//   下标 > SegmentSize：段已满且已有人负责换段，不再访问这个段，等尾部字的下标回到段内后重试。
+//   段会被回收复用，地址可能和换段前一样，所以等的是下标而不是地址变化。
+// 消费者读完一个段且它的 Next 已经挂上后才回收它，回收的段留一个备用，换段时优先复用。
+template<typename T, size_t SegmentSize = 1024>
+class SegmentedMPSCQueue
+{
+    static constexpr size_t IndexBits = 12;
+    static constexpr size_t SegmentAlign = size_t(1) << IndexBits;
+    static constexpr uint64_t IndexMask = SegmentAlign - 1;
+
+    // 段满之后每个生产者最多再多加一次，剩下的位数要容纳所有并发生产者
+    static_assert(SegmentSize >= 2 && SegmentSize <= SegmentAlign / 2, "SegmentSize must be in [2, 2048]");
+
+public:
+    SegmentedMPSCQueue() : _spare(nullptr)
+    {
+        Segment* segment = NewSegment();
+        _tail.store(Pack(segment, 0), std::memory_order_relaxed);
+        _headSegment = segment;
+        _headIndex = 0;
+    }
+
+    ~SegmentedMPSCQueue()
+    {
+        // 此时已经没有生产者，就地析构剩余元素，不要求 T 可默认构造
+        Segment* segment = _headSegment;
+        size_t index = _headIndex;
+        while (segment)
+        {
+            for (; index < SegmentSize && segment->Slots[index].Ready.load(std::memory_order_relaxed); ++index)
+                reinterpret_cast<T*>(&segment->Slots[index].Storage)->~T();
+
+            Segment* next = segment->Next.load(std::memory_order_relaxed);
+            DeleteSegment(segment);
+            segment = next;
+            index = 0;
+        }
+
+        DeleteSegment(_spare.load(std::memory_order_relaxed));
+    }
+
+    void Enqueue(const T& input) { Emplace(input); }
+    void Enqueue(T&& input) { Emplace(std::move(input)); }
+
+    // 入队，多个生产者可以同时调用
+    template<typename... Args>
+    void Emplace(Args&&... args)
+    {
+        Slot* slot = Claim();
+        new (&slot->Storage) T(std::forward<Args>(args)...);
+        slot->Ready.store(true, std::memory_order_release);
+        _stats.OnEnqueue();
+        _waiter.Notify();
+    }
+
+    // 出队，队列为空时返回 false，只能由消费者调用
+    bool Dequeue(T& result)
+    {
+        if (!TryDequeue(result))
+        {
+            _stats.OnEmptyPoll();
+            return false;
+        }
+
+        _stats.OnDequeue();
+        return true;
+    }
+
+    // 阻塞出队：队列为空时先自旋，再在 futex 上睡眠直到有元素入队
+    void DequeueWait(T& result)
+    {
+        _waiter.Wait([&]() { return TryDequeue(result); }, [this]() { return IsEmpty(); }, nullptr, _stats);
+    }
+
+    // 带超时的阻塞出队，超时返回 false
+    template<typename Rep, typename Period>
+    bool DequeueWaitFor(T& result, std::chrono::duration<Rep, Period> const& timeout)
+    {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+        return _waiter.Wait([&]() { return TryDequeue(result); }, [this]() { return IsEmpty(); }, &deadline, _stats);
+    }
+
+    // 统计快照，未定义 MARK_QUEUE_STATS 时全为 0
+    QueueStatsSnapshot Stats() const { return _stats.Snapshot(); }
+
+private:
+    struct Slot
+    {
+        std::atomic<bool> Ready;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+    };
+
+    struct alignas(SegmentAlign) Segment
+    {
+        Segment() : Next(nullptr)
+        {
+            for (size_t i = 0; i < SegmentSize; ++i)
+                Slots[i].Ready.store(false, std::memory_order_relaxed);
+        }
+
+        Slot Slots[SegmentSize];
+        std::atomic<Segment*> Next;
+    };
+
+    static uint64_t Pack(Segment* segment, uint64_t index) { return reinterpret_cast<uintptr_t>(segment) | index; }
+    static Segment* SegmentOf(uint64_t tail) { return reinterpret_cast<Segment*>(tail & ~IndexMask); }
+
+    // 领取一个槽位
+    Slot* Claim()
+    {
+        for (;;)
+        {
+            uint64_t tail = _tail.fetch_add(1, std::memory_order_seq_cst);
+            Segment* segment = SegmentOf(tail);
+            uint64_t index = tail & IndexMask;
+            if (index < SegmentSize)
+                return &segment->Slots[index];
+
+            if (index == SegmentSize)
+            {
+                // 消费者在 Next 挂上之前不会离开这个段，所以这里访问它是安全的
+                Segment* next = _spare.exchange(nullptr, std::memory_order_acquire);
+                if (!next)
+                    next = NewSegment();
+                next->Next.store(nullptr, std::memory_order_relaxed);
+                _tail.store(Pack(next, 1), std::memory_order_release);
+                segment->Next.store(next, std::memory_order_release);
+                return &next->Slots[0];
+            }
+
+            // 不再访问 segment，等负责换段的生产者完成。新段可能正是回收后复用的同一个段，
+            // 比较地址会一直等到它再次写满，所以只看下标：换段后下标从 1 开始，一定小于 SegmentSize
+            while ((_tail.load(std::memory_order_acquire) & IndexMask) >= SegmentSize)
+                std::this_thread::yield();
+        }
+    }
+
+    // 不计数的出队，阻塞等待时反复调用
+    bool TryDequeue(T& result)
+    {
+        if (_headIndex == SegmentSize)
+        {
+            Segment* next = _headSegment->Next.load(std::memory_order_acquire);
+            if (!next)
+                return false;
+
+            Recycle(_headSegment);
+            _headSegment = next;
+            _headIndex = 0;
+        }
+
+        Slot& slot = _headSegment->Slots[_headIndex];
+        if (!slot.Ready.load(std::memory_order_acquire))
+            return false;
+
+        T* element = reinterpret_cast<T*>(&slot.Storage);
+        result = std::move(*element);
+        element->~T();
+        slot.Ready.store(false, std::memory_order_relaxed);
+        ++_headIndex;
+        return true;
+    }
+
+    // 读完的段留一个备用，多余的释放
+    void Recycle(Segment* segment)
+    {
+        Segment* expected = nullptr;
+        if (!_spare.compare_exchange_strong(expected, segment, std::memory_order_release, std::memory_order_relaxed))
+            DeleteSegment(segment);
+    }
+
+    // 队列为空且没有进行到一半的入队，只由消费者调用
+    bool IsEmpty() const
+    {
+        uint64_t tail = _tail.load(std::memory_order_seq_cst);
+        uint64_t index = tail & IndexMask;
+        return SegmentOf(tail) == _headSegment && (index < SegmentSize ? index : SegmentSize) == _headIndex;
+    }
+
+    static Segment* NewSegment() { return new Segment(); }
+    static void DeleteSegment(Segment* segment) { delete segment; }
+
+    // 生产者区域
+    alignas(CacheLineSize) std::atomic<uint64_t> _tail; // 尾段地址 | 段内已领取的槽位数
+    MPSCConsumerWaiter _waiter; // 阻塞出队时的睡眠/唤醒
+
+    // 消费者区域
+    alignas(CacheLineSize) Segment* _headSegment; // 正在读取的段
+    size_t _headIndex; // 下一个读取的槽位
+    std::atomic<Segment*> _spare; // 回收的备用段，消费者放入，换段的生产者取走
+    QueueStats _stats;
+
+    SegmentedMPSCQueue(SegmentedMPSCQueue const&) = delete;
+    SegmentedMPSCQueue& operator=(SegmentedMPSCQueue const&) = delete;
+};
+
+#endif
@@ -0,0 +1,140 @@
+// 多通道（分片）队列，用多个独立的 LockedQueue 分散生产者之间的锁竞争
+
+#ifndef _MARK_SHARDED_QUEUE_H
+#define _MARK_SHARDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CacheLine.h"
+#include "LockedQueue.h"
+
+// 每个通道是一个独立的队列（默认 LockedQueue，也可以是 MPMCQueue 等提供 add/next/empty/cancel 的队列），
+// 各自单独分配并按缓存行对齐，互不共享锁和缓存行。
+// 生产者：add(item) 按线程固定到一个通道；add(key, item) 按 key 的哈希选通道，
+//         同一个 key 总在同一个通道里，因此同一 key 的消息按入队顺序出队（每 key 先进先出）。
+// 消费者：RoundRobin 每次从上次的下一个通道开始轮询；
+//         WorkStealing 优先取自己的通道，自己的为空再去偷别的通道。
+template<class T, class Lane = LockedQueue<T>>
+class ShardedQueue
+{
+public:
+    enum DrainPolicy
+    {
+        RoundRobin,
+        WorkStealing
+    };
+
+    // lanes 为 0 时取 CPU 核数，laneArgs 转发给每个通道的构造函数
+    template<class... LaneArgs>
+    explicit ShardedQueue(size_t lanes = 0, DrainPolicy policy = RoundRobin, LaneArgs&&... laneArgs)
+        : _policy(policy), _canceled(false)
+    {
+        if (lanes == 0)
+            lanes = std::thread::hardware_concurrency();
+        if (lanes == 0)
+            lanes = 1;
+
+        _lanes.reserve(lanes);
+        for (size_t i = 0; i < lanes; ++i)
+            _lanes.emplace_back(new PaddedLane(laneArgs...));
+    }
+
+    // 按线程选择通道
+    void add(const T& item) { LaneFor(ThreadIndex()).add(item); }
+    void add(T&& item) { LaneFor(ThreadIndex()).add(std::move(item)); }
+
+    // 按 key 选择通道，保证同一 key 的先进先出
+    template<class Key>
+    void add(const Key& key, const T& item) { LaneFor(std::hash<Key>()(key)).add(item); }
+
+    template<class Key>
+    void add(const Key& key, T&& item) { LaneFor(std::hash<Key>()(key)).add(std::move(item)); }
+
+    // 取出一个元素，所有通道都为空时返回 false
+    bool next(T& result)
+    {
+        size_t lanes = _lanes.size();
+        size_t& cursor = Cursor();
+        size_t start = _policy == WorkStealing ? ThreadIndex() : cursor;
+
+        for (size_t i = 0; i < lanes; ++i)
+        {
+            size_t index = (start + i) % lanes;
+            if (_lanes[index]->Queue.next(result))
+            {
+                cursor = index + 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //! Cancels all lanes.
+    void cancel()
+    {
+        _canceled.store(true, std::memory_order_release);
+        for (auto& lane : _lanes)
+            lane->Queue.cancel();
+    }
+
+    //! Checks if the queue is cancelled.
+    bool cancelled()
+    {
+        return _canceled.load(std::memory_order_acquire);
+    }
+
+    ///! Checks if every lane is empty
+    bool empty()
+    {
+        for (auto& lane : _lanes)
+            if (!lane->Queue.empty())
+                return false;
+        return true;
+    }
+
+    size_t lanes() const { return _lanes.size(); }
+
+    // 直接访问某个通道，例如消费者只处理固定通道时
+    Lane& lane(size_t index) { return _lanes[index]->Queue; }
+
+private:
+    struct alignas(CacheLineSize) PaddedLane
+    {
+        template<class... LaneArgs>
+        explicit PaddedLane(LaneArgs&... laneArgs) : Queue(laneArgs...) {}
+
+        Lane Queue;
+    };
+
+    Lane& LaneFor(size_t hash) { return _lanes[hash % _lanes.size()]->Queue; }
+
+    // 进程内每个线程一个固定编号，第一次使用时分配
+    static size_t ThreadIndex()
+    {
+        static std::atomic<size_t> counter(0);
+        static thread_local size_t index = counter.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    // 消费者轮询的起点，每个线程一份
+    static size_t& Cursor()
+    {
+        static thread_local size_t cursor = ThreadIndex();
+        return cursor;
+    }
+
+    std::vector<std::unique_ptr<PaddedLane>> _lanes;
+    DrainPolicy _policy;
+    std::atomic<bool> _canceled;
+
+    ShardedQueue(ShardedQueue const&) = delete;
+    ShardedQueue& operator=(ShardedQueue const&) = delete;
+};
+
+#endif
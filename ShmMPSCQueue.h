@@ -0,0 +1,311 @@
+// 进程间共享内存上的多生产者单消费者队列，生产者和消费者可以是不同的进程
+
+#ifndef _MARK_SHM_MPSC_QUEUE_H
+#define _MARK_SHM_MPSC_QUEUE_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CacheLine.h"
+#include "MPSCQueue.h"
+
+// 整个队列放在一块 shm_open/mmap 的共享内存里：开头是控制块，后面是定长槽位组成的消息区。
+// 各进程映射的地址不同，所以链接和空闲链表里存的都是相对共享内存起始处的偏移，而不是指针。
+//
+// 队列算法和 MPSCQueueNonIntrusive 相同（Vyukov 非侵入式 MPSC），消息内容直接写在槽位里，不再拷贝：
+//   生产者：Allocate() 从消息区取一个槽位，直接把消息写进去，再 Enqueue(payload, length)；
+//           取槽位是空闲链表上的 CAS，入队是一次 exchange，快路径上没有系统调用。
+//   消费者：Dequeue() 返回的消息指针指向共享内存，一直有效到下一次出队，
+//           因为消息所在的槽位这时成了新的 dummy 节点，下一次出队才会把它还给空闲链表。
+// 消费者空闲时在共享 futex 上睡眠，生产者只有在消费者确实睡着时才发起唤醒系统调用。
+//
+// 空闲链表由多个生产者弹出、消费者压入，栈顶带 32 位版本号防止 ABA。
+// 限制：生产者进程如果死在 exchange 和链接之间，消费者之后会一直看到队列为空。
+// glibc 2.34 之前 shm_open 需要链接 -lrt。
+class ShmMPSCQueue
+{
+public:
+    // 创建共享内存并初始化队列，slotSize 为单条消息的最大字节数，失败返回 nullptr 并设置 errno
+    static std::unique_ptr<ShmMPSCQueue> Create(const char* name, uint32_t slotSize, uint32_t slotCount)
+    {
+        if (slotCount < 2 || slotSize == 0)
+        {
+            errno = EINVAL;
+            return nullptr;
+        }
+
+        uint64_t stride = RoundUp(sizeof(Node) + slotSize);
+        uint64_t size = RoundUp(sizeof(Header)) + stride * slotCount;
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            return nullptr;
+
+        if (ftruncate(fd, size) != 0)
+        {
+            int err = errno;
+            close(fd);
+            shm_unlink(name);
+            errno = err;
+            return nullptr;
+        }
+
+        std::unique_ptr<ShmMPSCQueue> queue(Map(fd, size));
+        if (!queue)
+        {
+            int err = errno;
+            shm_unlink(name);
+            errno = err;
+            return nullptr;
+        }
+
+        Header* header = new (queue->_base) Header();
+        header->Size = size;
+        header->SlotSize = slotSize;
+        header->SlotCount = slotCount;
+        header->Stride = stride;
+        header->SlotsOffset = RoundUp(sizeof(Header));
+
+        // 0 号槽位作为初始 dummy 节点，其余槽位串成空闲链表
+        Node* stub = queue->NodeAt(0);
+        stub->Next.store(0, std::memory_order_relaxed);
+        header->Head.store(queue->Offset(stub), std::memory_order_relaxed);
+        header->Tail.store(queue->Offset(stub), std::memory_order_relaxed);
+        for (uint32_t i = 1; i < slotCount; ++i)
+            queue->NodeAt(i)->Next.store(i + 1 < slotCount ? i + 1 : 0, std::memory_order_relaxed);
+        header->FreeTop.store(1, std::memory_order_relaxed);
+
+        // 最后写入 Magic，其他进程看到它才认为队列已经初始化完成
+        header->Magic.store(MagicValue, std::memory_order_release);
+        return queue;
+    }
+
+    // 打开其他进程创建的队列，失败返回 nullptr 并设置 errno
+    static std::unique_ptr<ShmMPSCQueue> Open(const char* name)
+    {
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0)
+            return nullptr;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+        {
+            close(fd);
+            errno = EAGAIN;
+            return nullptr;
+        }
+
+        std::unique_ptr<ShmMPSCQueue> queue(Map(fd, st.st_size));
+        if (!queue)
+            return nullptr;
+
+        if (queue->_header->Magic.load(std::memory_order_acquire) != MagicValue ||
+            queue->_header->Size != static_cast<uint64_t>(st.st_size))
+        {
+            errno = EAGAIN;
+            return nullptr;
+        }
+        return queue;
+    }
+
+    // 删除共享内存的名字，已经映射的进程不受影响
+    static int Unlink(const char* name) { return shm_unlink(name); }
+
+    ~ShmMPSCQueue() { munmap(_base, _size); }
+
+    // 取一个槽位用于写消息，消息区用完时返回 nullptr，生产者调用
+    void* Allocate()
+    {
+        Node* node = PopFree();
+        return node ? node->Payload() : nullptr;
+    }
+
+    // 把 Allocate 得到的槽位入队，length 不能超过 SlotSize()
+    void Enqueue(void* payload, uint32_t length)
+    {
+        Node* node = Node::FromPayload(payload);
+        node->Length = length;
+        node->Next.store(0, std::memory_order_relaxed);
+        uint64_t prev = _header->Head.exchange(Offset(node), std::memory_order_seq_cst);
+        NodeAtOffset(prev)->Next.store(Offset(node), std::memory_order_release);
+        _header->Waiter.Notify();
+        _stats.OnEnqueue();
+    }
+
+    // 拷贝一条消息入队，消息太长或消息区用完时返回 false
+    bool EnqueueCopy(const void* data, uint32_t length)
+    {
+        if (length > _header->SlotSize)
+            return false;
+
+        void* payload = Allocate();
+        if (!payload)
+            return false;
+
+        std::memcpy(payload, data, length);
+        Enqueue(payload, length);
+        return true;
+    }
+
+    // 出队，返回的指针在下一次出队之前有效，只能由消费者调用
+    bool Dequeue(const void*& payload, uint32_t& length)
+    {
+        if (!TryDequeue(payload, length))
+        {
+            _stats.OnEmptyPoll();
+            return false;
+        }
+
+        _stats.OnDequeue();
+        return true;
+    }
+
+    // 阻塞出队：队列为空时先自旋，再在共享 futex 上睡眠
+    void DequeueWait(const void*& payload, uint32_t& length)
+    {
+        _header->Waiter.Wait([&]() { return TryDequeue(payload, length); }, [this]() { return IsEmpty(); }, nullptr,
+            _stats);
+    }
+
+    // 带超时的阻塞出队，超时返回 false
+    template<typename Rep, typename Period>
+    bool DequeueWaitFor(const void*& payload, uint32_t& length, std::chrono::duration<Rep, Period> const& timeout)
+    {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+        return _header->Waiter.Wait([&]() { return TryDequeue(payload, length); }, [this]() { return IsEmpty(); },
+            &deadline, _stats);
+    }
+
+    uint32_t SlotSize() const { return _header->SlotSize; }
+    uint32_t SlotCount() const { return _header->SlotCount; }
+
+    // 本进程的统计快照（每个进程各自计数）
+    QueueStatsSnapshot Stats() const { return _stats.Snapshot(); }
+
+private:
+    static constexpr uint32_t MagicValue = 0x4d53504d; // "MPSM"
+
+    // 槽位头部，消息内容紧跟在后面
+    struct Node
+    {
+        std::atomic<uint64_t> Next; // 在队列中时是下一个节点的偏移，在空闲链表中是下一个空闲槽位的编号 + 1
+        uint32_t Length;
+
+        void* Payload() { return this + 1; }
+        static Node* FromPayload(void* payload) { return static_cast<Node*>(payload) - 1; }
+    };
+
+    // 共享内存开头的控制块，生产者写的字段和消费者写的字段分在不同的缓存行
+    struct Header
+    {
+        Header() : Magic(0), Waiter(true), Head(0), Tail(0), FreeTop(0) {}
+
+        std::atomic<uint32_t> Magic;
+        uint32_t SlotSize;
+        uint32_t SlotCount;
+        uint64_t Size;
+        uint64_t Stride;
+        uint64_t SlotsOffset;
+
+        alignas(CacheLineSize) MPSCConsumerWaiter Waiter;
+        std::atomic<uint64_t> Head; // 最后入队节点的偏移，生产者 exchange
+
+        alignas(CacheLineSize) std::atomic<uint64_t> Tail; // dummy 节点的偏移，只由消费者写
+
+        alignas(CacheLineSize) std::atomic<uint64_t> FreeTop; // 高 32 位版本号，低 32 位空闲槽位编号 + 1
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs address-free atomics");
+
+    ShmMPSCQueue(char* base, size_t size) : _base(base), _size(size), _header(reinterpret_cast<Header*>(base)) {}
+
+    static ShmMPSCQueue* Map(int fd, size_t size)
+    {
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int err = errno;
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            errno = err;
+            return nullptr;
+        }
+        return new ShmMPSCQueue(static_cast<char*>(base), size);
+    }
+
+    static uint64_t RoundUp(uint64_t size) { return (size + CacheLineSize - 1) / CacheLineSize * CacheLineSize; }
+
+    Node* NodeAt(uint32_t index) { return reinterpret_cast<Node*>(_base + _header->SlotsOffset + index * _header->Stride); }
+    Node* NodeAtOffset(uint64_t offset) { return reinterpret_cast<Node*>(_base + offset); }
+    uint64_t Offset(Node* node) const { return reinterpret_cast<char*>(node) - _base; }
+    uint32_t Index(Node* node) const { return (Offset(node) - _header->SlotsOffset) / _header->Stride; }
+
+    Node* PopFree()
+    {
+        uint64_t top = _header->FreeTop.load(std::memory_order_acquire);
+        for (;;)
+        {
+            uint32_t slot = static_cast<uint32_t>(top);
+            if (!slot)
+                return nullptr;
+
+            Node* node = NodeAt(slot - 1);
+            // 节点可能已经被别的生产者取走并改写了 Next，这时版本号也变了，CAS 会失败
+            uint64_t next = node->Next.load(std::memory_order_relaxed) & 0xffffffffu;
+            uint64_t update = ((top >> 32) + 1) << 32 | next;
+            if (_header->FreeTop.compare_exchange_weak(top, update, std::memory_order_acquire, std::memory_order_acquire))
+                return node;
+        }
+    }
+
+    void PushFree(Node* node)
+    {
+        uint64_t slot = Index(node) + 1;
+        uint64_t top = _header->FreeTop.load(std::memory_order_relaxed);
+        uint64_t update;
+        do
+        {
+            node->Next.store(top & 0xffffffffu, std::memory_order_relaxed);
+            update = ((top >> 32) + 1) << 32 | slot;
+        } while (!_header->FreeTop.compare_exchange_weak(top, update, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // 不计数的出队，阻塞等待时反复调用
+    bool TryDequeue(const void*& payload, uint32_t& length)
+    {
+        Node* tail = NodeAtOffset(_header->Tail.load(std::memory_order_relaxed));
+        uint64_t next = tail->Next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+
+        Node* node = NodeAtOffset(next);
+        payload = node->Payload();
+        length = node->Length;
+        _header->Tail.store(next, std::memory_order_release);
+        PushFree(tail);
+        return true;
+    }
+
+    bool IsEmpty() const
+    {
+        return _header->Head.load(std::memory_order_seq_cst) == _header->Tail.load(std::memory_order_relaxed);
+    }
+
+    char* _base; // 本进程中共享内存的映射地址
+    size_t _size;
+    Header* _header;
+    QueueStats _stats;
+
+    ShmMPSCQueue(ShmMPSCQueue const&) = delete;
+    ShmMPSCQueue& operator=(ShmMPSCQueue const&) = delete;
+};
+
+#endif
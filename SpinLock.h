@@ -0,0 +1,113 @@
+// 短临界区用的锁，可以作为 LockedQueue 的 LockType 模板参数，都满足 BasicLockable（lock/unlock）
+
+#ifndef _MARK_SPIN_LOCK_H
+#define _MARK_SPIN_LOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "CacheLine.h"
+#include "Futex.h"
+
+// 排队自旋锁（ticket lock）：取号后自旋等待叫号，严格按到达顺序获得锁，不会饿死。
+// 等待时间和前面排队的人数成正比地退避；自旋太久（例如持锁线程被换出）后让出 CPU，
+// 但始终不进内核睡眠，适合临界区只有几次指针写、且线程数不超过核数的场景。
+class TicketSpinLock
+{
+public:
+    static constexpr int YieldAfter = 128; // 累计自旋多少次 pause 之后开始让出 CPU
+
+    TicketSpinLock() : _next(0), _serving(0) {}
+
+    void lock()
+    {
+        uint32_t ticket = _next.fetch_add(1, std::memory_order_relaxed);
+        int spin = 0;
+        for (;;)
+        {
+            uint32_t serving = _serving.load(std::memory_order_acquire);
+            if (serving == ticket)
+                return;
+
+            if (spin < YieldAfter)
+            {
+                spin += ticket - serving;
+                for (uint32_t i = 0; i < ticket - serving; ++i)
+                    CpuRelax();
+            }
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    bool try_lock()
+    {
+        uint32_t serving = _serving.load(std::memory_order_relaxed);
+        uint32_t ticket = serving;
+        return _next.compare_exchange_strong(ticket, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock()
+    {
+        _serving.store(_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint32_t> _next;    // 下一个号
+    std::atomic<uint32_t> _serving; // 正在服务的号
+
+    TicketSpinLock(TicketSpinLock const&) = delete;
+    TicketSpinLock& operator=(TicketSpinLock const&) = delete;
+};
+
+// 自适应锁：先自旋一小段时间，拿不到再在 futex 上睡眠。
+// 状态 0 未加锁，1 加锁且无人睡眠，2 加锁且可能有人睡眠；只有状态为 2 时解锁才发起唤醒系统调用，
+// 所以无竞争和短暂竞争时完全不进内核。
+class SpinFutexLock
+{
+public:
+    static constexpr int SpinCount = 100; // 睡眠前的自旋次数
+
+    SpinFutexLock() : _state(0) {}
+
+    void lock()
+    {
+        uint32_t state = 0;
+        if (_state.compare_exchange_strong(state, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return;
+
+        for (int spin = 0; spin < SpinCount; ++spin)
+        {
+            CpuRelax();
+            state = 0;
+            if (_state.load(std::memory_order_relaxed) == 0 &&
+                _state.compare_exchange_weak(state, 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+        }
+
+        // 标记为有人睡眠后再等，拿到锁时状态保持为 2，解锁时会唤醒下一个
+        while (_state.exchange(2, std::memory_order_acquire) != 0)
+            FutexWait(&_state, 2);
+    }
+
+    bool try_lock()
+    {
+        uint32_t state = 0;
+        return _state.compare_exchange_strong(state, 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock()
+    {
+        if (_state.exchange(0, std::memory_order_release) == 2)
+            FutexWake(&_state, 1);
+    }
+
+private:
+    std::atomic<uint32_t> _state;
+
+    SpinFutexLock(SpinFutexLock const&) = delete;
+    SpinFutexLock& operator=(SpinFutexLock const&) = delete;
+};
+
+#endif
@@ -0,0 +1,139 @@
+// Chase-Lev 工作窃取双端队列：所有者在底部压入/弹出，其他线程从顶部窃取
+
+#ifndef _MARK_WORK_STEALING_DEQUE_H
+#define _MARK_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "CacheLine.h"
+
+// 实现按 Lê、Pop、Cohen、Zappa Nardelli 的 C11 内存模型版本（PPoPP 2013）。
+// 所有者的 Push/Pop 在无竞争时没有原子读改写，只有弹出最后一个元素时和窃取者 CAS 竞争；
+// 窃取者之间用 _top 上的 CAS 竞争。
+// 数组满时所有者把它扩容一倍，旧数组可能还在被窃取者读取，留到析构时才释放。
+// 元素存放在原子变量里，T 需要可平凡复制，一般是任务指针。
+template<typename T>
+class WorkStealingDeque
+{
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque stores T in std::atomic<T>");
+
+public:
+    // capacity 会向上取整到 2 的幂
+    explicit WorkStealingDeque(size_t capacity = 1024) : _top(0), _bottom(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        _array.store(new Array(size), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingDeque()
+    {
+        delete _array.load(std::memory_order_relaxed);
+        for (Array* array : _retired)
+            delete array;
+    }
+
+    // 压入底部，只能由所有者调用
+    void Push(T item)
+    {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        int64_t top = _top.load(std::memory_order_acquire);
+        Array* array = _array.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(array->Mask))
+            array = Grow(array, top, bottom);
+
+        array->Put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // 从底部弹出（后进先出），为空时返回 false，只能由所有者调用
+    bool Pop(T& item)
+    {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        Array* array = _array.load(std::memory_order_relaxed);
+        _bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = _top.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            // 空
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = array->Get(bottom);
+        if (top == bottom)
+        {
+            // 最后一个元素，和窃取者竞争
+            bool won = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 从顶部窃取（先进先出），为空或与其他线程竞争失败时返回 false，任何线程都可以调用
+    bool Steal(T& item)
+    {
+        int64_t top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = _bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return false;
+
+        Array* array = _array.load(std::memory_order_acquire);
+        item = array->Get(top);
+        return _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // 近似的元素个数
+    size_t Size() const
+    {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        int64_t top = _top.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+    bool Empty() const { return Size() == 0; }
+
+private:
+    struct Array
+    {
+        explicit Array(size_t size) : Mask(size - 1), Slots(new std::atomic<T>[size]) {}
+        ~Array() { delete[] Slots; }
+
+        T Get(int64_t index) const { return Slots[index & Mask].load(std::memory_order_relaxed); }
+        void Put(int64_t index, T item) { Slots[index & Mask].store(item, std::memory_order_relaxed); }
+
+        const size_t Mask;
+        std::atomic<T>* const Slots;
+    };
+
+    Array* Grow(Array* array, int64_t top, int64_t bottom)
+    {
+        Array* bigger = new Array((array->Mask + 1) * 2);
+        for (int64_t i = top; i < bottom; ++i)
+            bigger->Put(i, array->Get(i));
+
+        _retired.push_back(array);
+        _array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(CacheLineSize) std::atomic<int64_t> _top;    // 窃取者一侧
+    alignas(CacheLineSize) std::atomic<int64_t> _bottom; // 所有者一侧
+    std::atomic<Array*> _array;
+    std::vector<Array*> _retired; // 扩容后换下的数组，只由所有者访问
+
+    WorkStealingDeque(WorkStealingDeque const&) = delete;
+    WorkStealingDeque& operator=(WorkStealingDeque const&) = delete;
+};
+
+#endif
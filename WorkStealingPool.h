@@ -0,0 +1,325 @@
+// 基于工作窃取的线程池：每个工作线程一个 WorkStealingDeque，外部提交经每个线程的 MPSCQueue 收件箱进入
+
+#ifndef _MARK_WORK_STEALING_POOL_H
+#define _MARK_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CacheLine.h"
+#include "Futex.h"
+#include "MPSCQueue.h"
+#include "WorkStealingDeque.h"
+
+// 任务来源按顺序：
+//   1. 自己的双端队列底部（后进先出，刚产生的子任务还在缓存里）；
+//   2. 自己的收件箱，一次取一批放进自己的双端队列，这样其他线程也能窃取；
+//   3. 从其他线程的双端队列顶部窃取；
+//   4. 取其他线程的收件箱，主人忙于长任务时投给它的任务不必等它。
+// 收件箱仍是单消费者队列，取之前先拿到它的消费令牌（一个标志位的 exchange），拿不到就跳过。
+// 工作线程里提交的任务直接压入自己的双端队列，没有任何共享的写；
+// 外部线程提交时轮流投到各工作线程的收件箱（MPSC，入队只有一次 exchange）。
+// 都取不到任务的线程在自己的 futex 上睡眠，提交方只有在有线程睡眠时才发起唤醒：
+// 外部提交优先投给正在睡眠的线程并唤醒它；没有线程睡眠时轮询投递，
+// 这时如果恰好有线程刚睡下，就唤醒任意一个，由它去取收件箱。
+// 压入双端队列的任务谁都能窃取，唤醒任意一个睡眠的线程，从收件箱搬进双端队列的一批任务也是这样。
+class WorkStealingPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    static constexpr int SpinCount = 64;     // 睡眠前重试的轮数
+    static constexpr size_t InboxBatch = 32; // 每次从收件箱取出的最大个数
+
+    // threads 为 0 时取 CPU 核数
+    explicit WorkStealingPool(size_t threads = 0) : _stop(false), _sleepers(0), _next(0)
+    {
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+
+        for (size_t i = 0; i < threads; ++i)
+            _workers.emplace_back(new Worker());
+        for (size_t i = 0; i < threads; ++i)
+            _workers[i]->Thread = std::thread(&WorkStealingPool::Run, this, i);
+    }
+
+    // 停止所有工作线程，还没执行的任务被丢弃
+    ~WorkStealingPool()
+    {
+        _stop.store(true, std::memory_order_seq_cst);
+        for (auto& worker : _workers)
+        {
+            worker->Wake.fetch_add(1, std::memory_order_seq_cst);
+            FutexWake(&worker->Wake, 1);
+        }
+        for (auto& worker : _workers)
+            worker->Thread.join();
+
+        Task* task;
+        for (auto& worker : _workers)
+        {
+            while (worker->Deque.Pop(task))
+                delete task;
+            while (worker->Inbox.Dequeue(task))
+                delete task;
+        }
+    }
+
+    // 提交任务，任何线程都可以调用
+    void Submit(Task task)
+    {
+        Task* item = new Task(std::move(task));
+        if (Current().Pool == this)
+        {
+            _workers[Current().Index]->Deque.Push(item);
+            WakeAny();
+        }
+        else
+        {
+            Worker& worker = *_workers[Target()];
+            worker.Inbox.Enqueue(item);
+
+            // 先唤醒收件箱的主人；它醒着（可能正忙于长任务）时，与 Sleep 配对唤醒任意一个睡眠的线程
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!TryWake(worker))
+                WakeAny();
+        }
+    }
+
+    // 执行一个待执行的任务，没有任务时返回 false。
+    // 用于等待子任务时帮忙干活（见 TaskGroup）；外部线程调用时只能窃取
+    bool RunPendingTask()
+    {
+        Task* task = Current().Pool == this ? Find(Current().Index) : StealAny(nullptr, 0);
+        if (!task)
+            return false;
+
+        Execute(task);
+        return true;
+    }
+
+    size_t Threads() const { return _workers.size(); }
+
+private:
+    struct alignas(CacheLineSize) Worker
+    {
+        WorkStealingDeque<Task*> Deque;
+        MPSCQueueNonIntrusive<Task> Inbox; // 外部线程提交的任务，持有消费令牌的线程才能取出
+        std::atomic<bool> InboxTaken;      // 收件箱的消费令牌
+        std::thread Thread;
+        std::atomic<uint32_t> Wake;        // 每次唤醒加一，本线程在上面睡眠
+        std::atomic<bool> Sleeping;        // 正在或准备睡眠，唤醒方用 exchange 认领
+
+        Worker() : InboxTaken(false), Wake(0), Sleeping(false) {}
+    };
+
+    struct ThreadState
+    {
+        WorkStealingPool* Pool = nullptr;
+        size_t Index = 0;
+    };
+
+    static ThreadState& Current()
+    {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    void Run(size_t index)
+    {
+        Current().Pool = this;
+        Current().Index = index;
+
+        int spin = 0;
+        while (!_stop.load(std::memory_order_relaxed))
+        {
+            if (Task* task = Find(index))
+            {
+                Execute(task);
+                spin = 0;
+            }
+            else if (++spin < SpinCount)
+                std::this_thread::yield();
+            else
+            {
+                Sleep(index);
+                spin = 0;
+            }
+        }
+    }
+
+    Task* Find(size_t index)
+    {
+        Worker& self = *_workers[index];
+        Task* task;
+        if (self.Deque.Pop(task))
+            return task;
+
+        if (TakeInbox(self, &self, task))
+            return task;
+
+        return StealAny(&self, index + 1);
+    }
+
+    // 从 start 开始依次尝试窃取其他线程的任务，双端队列都是空的再取它们的收件箱。
+    // self 是调用方的工作线程，外部线程为 nullptr
+    Task* StealAny(Worker* self, size_t start)
+    {
+        size_t threads = _workers.size();
+        Task* task;
+        for (size_t i = 0; i < threads; ++i)
+        {
+            if (_workers[(start + i) % threads]->Deque.Steal(task))
+                return task;
+        }
+        for (size_t i = 0; i < threads; ++i)
+        {
+            Worker& worker = *_workers[(start + i) % threads];
+            if (&worker != self && TakeInbox(worker, self, task))
+                return task;
+        }
+        return nullptr;
+    }
+
+    // 拿到 worker 收件箱的消费令牌后取出一批，第一个返回，其余压入 self 的双端队列供窃取；
+    // 外部线程没有双端队列，只取一个
+    bool TakeInbox(Worker& worker, Worker* self, Task*& task)
+    {
+        if (worker.Inbox.Empty() || worker.InboxTaken.exchange(true, std::memory_order_acquire))
+            return false;
+
+        Task* batch[InboxBatch];
+        size_t count = worker.Inbox.DequeueBulk(batch, self ? InboxBatch : 1);
+        worker.InboxTaken.store(false, std::memory_order_release);
+        if (!count)
+            return false;
+
+        if (self && count > 1)
+        {
+            for (size_t i = 1; i < count; ++i)
+                self->Deque.Push(batch[i]);
+            WakeAny();
+        }
+        task = batch[0];
+        return true;
+    }
+
+    void Sleep(size_t index)
+    {
+        Worker& self = *_workers[index];
+        uint32_t wake = self.Wake.load(std::memory_order_acquire);
+        _sleepers.fetch_add(1, std::memory_order_seq_cst);
+        self.Sleeping.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!HasWork() && !_stop.load(std::memory_order_relaxed))
+            FutexWait(&self.Wake, wake);
+        self.Sleeping.store(false, std::memory_order_relaxed);
+        _sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // 外部提交投递的收件箱：有线程睡眠时从轮询位置开始找一个睡眠的，否则轮询
+    size_t Target()
+    {
+        size_t threads = _workers.size();
+        size_t start = _next.fetch_add(1, std::memory_order_relaxed);
+        if (_sleepers.load(std::memory_order_relaxed))
+        {
+            for (size_t i = 0; i < threads; ++i)
+                if (_workers[(start + i) % threads]->Sleeping.load(std::memory_order_relaxed))
+                    return (start + i) % threads;
+        }
+        return start % threads;
+    }
+
+    // 刚压入自己双端队列的任务可以被任何线程窃取，有线程睡眠时唤醒一个。
+    // 与 Sleep 中的标记睡眠配对，保证要么这里看到有人睡眠，要么睡眠方看到新任务。
+    // 调用方自己醒着，任务总会被执行，这里唤醒一个只是为了并行
+    void WakeAny()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleepers.load(std::memory_order_relaxed))
+        {
+            for (auto& worker : _workers)
+                if (TryWake(*worker))
+                    break;
+        }
+    }
+
+    // worker 在睡眠时唤醒它；多个提交方同时看到它睡眠时只有一个发起系统调用
+    static bool TryWake(Worker& worker)
+    {
+        if (!worker.Sleeping.load(std::memory_order_relaxed) || !worker.Sleeping.exchange(false, std::memory_order_acq_rel))
+            return false;
+
+        worker.Wake.fetch_add(1, std::memory_order_release);
+        FutexWake(&worker.Wake, 1);
+        return true;
+    }
+
+    bool HasWork()
+    {
+        for (auto& worker : _workers)
+            if (!worker->Deque.Empty() || !worker->Inbox.Empty())
+                return true;
+        return false;
+    }
+
+    static void Execute(Task* task)
+    {
+        (*task)();
+        delete task;
+    }
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<bool> _stop;
+    alignas(CacheLineSize) std::atomic<uint32_t> _sleepers; // 正在或准备睡眠的线程数
+    alignas(CacheLineSize) std::atomic<size_t> _next;    // 外部提交轮询的下一个收件箱
+
+    WorkStealingPool(WorkStealingPool const&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool const&) = delete;
+};
+
+// fork/join：Run 派生子任务，Wait 等待全部完成，等待期间帮忙执行池里的任务而不是阻塞
+class TaskGroup
+{
+public:
+    explicit TaskGroup(WorkStealingPool& pool) : _pool(pool), _pending(0) {}
+
+    ~TaskGroup() { Wait(); }
+
+    template<typename Function>
+    void Run(Function&& function)
+    {
+        _pending.fetch_add(1, std::memory_order_relaxed);
+        _pool.Submit([this, function = std::forward<Function>(function)]() mutable {
+            function();
+            _pending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    void Wait()
+    {
+        while (_pending.load(std::memory_order_acquire))
+        {
+            if (!_pool.RunPendingTask())
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    WorkStealingPool& _pool;
+    std::atomic<size_t> _pending;
+
+    TaskGroup(TaskGroup const&) = delete;
+    TaskGroup& operator=(TaskGroup const&) = delete;
+};
+
+#endif
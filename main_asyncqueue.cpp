@@ -0,0 +1,113 @@
+#include "AsyncProducerConsumerQueue.h"
+#include "ProducerConsumerQueue.h"
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// 需要 C++20：g++ -std=c++20 main_asyncqueue.cpp -pthread
+// 1000 个消费者协程在 2 个工作线程上等待消息，Cancel 后全部以流结束退出
+#define CONSUMERS 1000
+#define MESSAGES 100000
+#define WORKERS 2
+
+// 最简单的协程类型：创建后立即运行，结束时自动销毁
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// 用 ProducerConsumerQueue 做执行器的任务队列，工作线程取出协程句柄并恢复
+class ThreadPoolExecutor {
+public:
+    explicit ThreadPoolExecutor(int threads) {
+        for(int i=0;i<threads;i++){
+            _workers.emplace_back([this]() {
+                for(;;) {
+                    std::coroutine_handle<> handle = nullptr;
+                    _tasks.WaitAndPop(handle);
+                    if(!handle)
+                        break;   // 任务队列已取消
+                    handle.resume();
+                }
+            });
+        }
+    }
+
+    ~ThreadPoolExecutor() {
+        _tasks.Cancel();
+        for(std::thread& t : _workers){
+            t.join();
+        }
+    }
+
+    void Post(std::coroutine_handle<> handle) { _tasks.Push(handle); }
+
+private:
+    ProducerConsumerQueue<std::coroutine_handle<>> _tasks;
+    std::vector<std::thread> _workers;
+};
+
+static std::atomic<long> received(0);
+static std::atomic<int> finished(0);
+
+static Detached consumer(AsyncProducerConsumerQueue<int, ThreadPoolExecutor>& queue) {
+    for(;;) {
+        std::optional<int> value = co_await queue.Pop();
+        if(!value)
+            break;   // 队列已取消
+        received.fetch_add(1, std::memory_order_relaxed);
+    }
+    finished.fetch_add(1, std::memory_order_relaxed);
+}
+
+int main() {
+    {
+        ThreadPoolExecutor executor(WORKERS);
+        AsyncProducerConsumerQueue<int, ThreadPoolExecutor> queue(executor);
+
+        for(int i=0;i<CONSUMERS;i++){
+            consumer(queue);
+        }
+
+        std::thread pd([&]() {
+            for(int i=0;i<MESSAGES;i++){
+                queue.Push(i);
+            }
+        });
+        pd.join();
+
+        while(received.load() < MESSAGES)
+            std::this_thread::yield();
+
+        queue.Cancel();
+        while(finished.load() < CONSUMERS)
+            std::this_thread::yield();
+    }
+
+    std::cout << CONSUMERS << " coroutines on " << WORKERS << " threads received " << received.load()
+              << " messages, " << finished.load() << " finished after Cancel" << std::endl;
+
+    // 默认执行器在 Push 的线程上直接恢复
+    AsyncProducerConsumerQueue<int> inline_queue;
+    inline_queue.Push(1);
+    [](AsyncProducerConsumerQueue<int>& q) -> Detached {
+        std::optional<int> a = co_await q.Pop();   // 已有元素，不挂起
+        std::optional<int> b = co_await q.Pop();   // 挂起，直到下面的 Push
+        std::cout << "inline executor: " << *a << " " << *b << std::endl;
+        std::optional<int> c = co_await q.Pop();
+        std::cout << "after Cancel: " << (c ? "value" : "end of stream") << std::endl;
+    }(inline_queue);
+    inline_queue.Push(2);
+    inline_queue.Cancel();
+
+    return 0;
+}
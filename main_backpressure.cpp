@@ -0,0 +1,166 @@
+#include "msgqueue.h"
+#include "LockedQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <iostream>
+
+// 消费者比生产者慢时几种限流方式下队列里最多积压多少条消息：
+//   非阻塞 put：不限流，积压一直增长；
+//   try_put：队列满时生产者丢弃消息；
+//   水位回调：到达高水位时生产者暂停，回到低水位再继续；
+//   信用：生产者先取信用再生产，队列里的消息数不超过 maxlen。
+#define MAXLEN 1024
+#define MESSAGES 200000
+
+struct Count {
+    Count(int _v) : v(_v), next(nullptr) {}
+    int v;
+    Count *next;
+};
+
+// 在 put 之前加一、get 之后减一，所以 peak 可能比队列里实际的消息数多几条
+static std::atomic<long> queued(0);
+static std::atomic<long> peak(0);
+
+static void on_put() {
+    long n = ++queued;
+    long p = peak.load(std::memory_order_relaxed);
+    while (n > p && !peak.compare_exchange_weak(p, n))
+        ;
+}
+
+// 消费者每取 64 条让出一次 CPU，模拟比生产者慢；收到 v < 0 的消息时退出
+static void consume(msgqueue_t *queue) {
+    for (int i = 1;; i++) {
+        Count *c = (Count *)msgqueue_get(queue);
+        if (!c) {
+            std::this_thread::yield();
+            continue;
+        }
+        queued--;
+        int v = c->v;
+        delete c;
+        if (v < 0)
+            break;
+        if (i % 64 == 0)
+            std::this_thread::yield();
+    }
+}
+
+// produce 返回丢弃的消息数
+template<typename Produce>
+static void run(const char *name, msgqueue_t *queue, Produce produce) {
+    queued = 0;
+    peak = 0;
+    std::thread cs(consume, queue);
+    long dropped = produce(queue);
+    cs.join();
+    std::cout << name << ": peak " << peak << " queued, " << dropped << " dropped" << std::endl;
+    msgqueue_destroy(queue);
+}
+
+static std::atomic<bool> paused(false);
+static std::atomic<int> marks(0);
+
+static void on_watermark(msgqueue_t *, int level, void *) {
+    paused = level == MSGQUEUE_WATERMARK_HIGH;
+    marks++;
+}
+
+int main() {
+    msgqueue_t *queue = msgqueue_create(MAXLEN, offsetof(Count, next));
+    msgqueue_set_nonblock(queue);
+    run("nonblocking put", queue, [](msgqueue_t *q) {
+        for (int i = 0; i < MESSAGES; i++) {
+            on_put();
+            msgqueue_put(new Count(i), q);
+        }
+        on_put();
+        msgqueue_put(new Count(-1), q);
+        return 0L;
+    });
+
+    queue = msgqueue_create(MAXLEN, offsetof(Count, next));
+    msgqueue_set_nonblock(queue);
+    run("try_put", queue, [](msgqueue_t *q) {
+        long dropped = 0;
+        for (int i = 0; i < MESSAGES; i++) {
+            Count *c = new Count(i);
+            on_put();
+            if (msgqueue_try_put(c, q) != 0) {
+                queued--;
+                delete c;
+                dropped++;
+            }
+        }
+        on_put();
+        msgqueue_put(new Count(-1), q);
+        return dropped;
+    });
+
+    queue = msgqueue_create(MAXLEN, offsetof(Count, next));
+    msgqueue_set_nonblock(queue);
+    msgqueue_set_watermarks(queue, MAXLEN / 4, MAXLEN, on_watermark, NULL);
+    run("watermarks", queue, [](msgqueue_t *q) {
+        for (int i = 0; i < MESSAGES; i++) {
+            while (paused.load())
+                std::this_thread::yield();
+            on_put();
+            msgqueue_put(new Count(i), q);
+        }
+        on_put();
+        msgqueue_put(new Count(-1), q);
+        return 0L;
+    });
+    std::cout << "  " << marks << " watermark callbacks" << std::endl;
+
+    // 四个生产者，每次取最多 32 个信用
+    queue = msgqueue_create_ex(MAXLEN, offsetof(Count, next), 1, MSGQUEUE_CREDITS);
+    run("credits", queue, [](msgqueue_t *q) {
+        std::thread producers[4];
+        for (std::thread& t : producers) {
+            t = std::thread([q]() {
+                for (int i = 0; i < MESSAGES / 4;) {
+                    size_t credits = msgqueue_acquire_credits(q, std::min(32, MESSAGES / 4 - i), -1);
+                    for (size_t k = 0; k < credits; k++, i++) {
+                        on_put();
+                        msgqueue_put(new Count(i), q);
+                    }
+                }
+            });
+        }
+        for (std::thread& t : producers)
+            t.join();
+        msgqueue_acquire_credits(q, 1, -1);
+        on_put();
+        msgqueue_put(new Count(-1), q);
+        return 0L;
+    });
+
+    // 有界 LockedQueue
+    LockedQueue<int> locked(4);
+    int highs = 0, lows = 0;
+    locked.set_watermarks(1, 3, [&](bool high) { high ? highs++ : lows++; });
+    int added = 0;
+    for (int i = 0; i < 6; i++)
+        added += locked.try_add(i);
+    std::cout << "LockedQueue(4) try_add: " << added << " of 6 accepted" << std::endl;
+    int v;
+    locked.next(v);
+    locked.next(v);
+    size_t got = locked.reserve(5);
+    std::cout << "reserve(5) after 2 removed: " << got << ", try_add: " << locked.try_add(9) << std::endl;
+    locked.add_reserved(10);
+    locked.unreserve(got - 1);
+    std::cout << "try_add after unreserve: " << locked.try_add(11) << std::endl;
+    std::cout << "add_reserved without a reservation when full: " << locked.add_reserved(12) << std::endl;
+    while (locked.next(v))
+        ;
+    std::cout << "watermark callbacks: " << highs << " high, " << lows << " low" << std::endl;
+    return 0;
+}
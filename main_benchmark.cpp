@@ -0,0 +1,326 @@
+// 统一的队列基准测试：所有队列跑同样的矩阵（生产者数 × 消费者数 × 消息大小 × 有界/无界），
+// 线程绑核，用单调时钟统计吞吐和入队到出队的延迟分位数，输出 CSV 或 JSON
+//
+// 用法: main_benchmark [--messages N] [--producers N] [--consumers N] [--queue NAME] [--json]
+
+#include "LockedQueue.h"
+#include "ProducerConsumerQueue.h"
+#include "MPSCQueue.h"
+#include "SegmentedMPSCQueue.h"
+#include "SPSCQueue.h"
+#include "MPMCQueue.h"
+#include "msgqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define BOUNDED_CAPACITY 1024
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void pin_thread(int index) {
+    int ncpu = std::thread::hardware_concurrency();
+    if (ncpu <= 0)
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % ncpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// 所有队列传递同样的消息：时间戳 + 链接字段 + 变长负载
+struct Msg {
+    uint64_t stamp;
+    Msg *next;                // msgqueue 的 linkoff 链接
+    std::atomic<Msg*> link;   // MPSCQueueIntrusive 的链接
+    char payload[1];
+
+    static Msg *create(size_t payload_size) {
+        Msg *msg = (Msg *)::operator new(offsetof(Msg, payload) + payload_size);
+        new (&msg->link) std::atomic<Msg*>(nullptr);
+        memset(msg->payload, 0x5a, payload_size);
+        msg->stamp = now_ns();
+        return msg;
+    }
+
+    static void destroy(Msg *msg) {
+        ::operator delete(msg);
+    }
+};
+
+// 各队列的适配器：push 失败表示队列满，pop 返回 nullptr 表示当前为空
+struct LockedAdapter {
+    static const char *name() { return "LockedQueue"; }
+    LockedQueue<Msg*> queue;
+    bool push(Msg *msg) { queue.add(msg); return true; }
+    Msg *pop() { Msg *msg; return queue.next(msg) ? msg : nullptr; }
+    void finish() {}
+};
+
+struct ProducerConsumerAdapter {
+    static const char *name() { return "ProducerConsumerQueue"; }
+    ProducerConsumerQueue<Msg*> queue;
+    bool push(Msg *msg) { queue.Push(msg); return true; }
+    Msg *pop() { Msg *msg; return queue.Pop(msg) ? msg : nullptr; }
+    void finish() {}
+};
+
+// 无界模式下 msgqueue 为非阻塞；有界模式下为阻塞，消费者在 get 中等待
+struct MsgQueueAdapter {
+    static const char *name() { return "msgqueue"; }
+    msgqueue_t *queue;
+    explicit MsgQueueAdapter(bool bounded) : queue(msgqueue_create(BOUNDED_CAPACITY, offsetof(Msg, next))) {
+        if (!bounded)
+            msgqueue_set_nonblock(queue);
+    }
+    ~MsgQueueAdapter() { msgqueue_destroy(queue); }
+    bool push(Msg *msg) { msgqueue_put(msg, queue); return true; }
+    Msg *pop() { return (Msg *)msgqueue_get(queue); }
+    void finish() { msgqueue_set_nonblock(queue); }
+};
+
+struct MPSCAdapter {
+    static const char *name() { return "MPSCQueueNonIntrusive"; }
+    MPSCQueue<Msg> queue;
+    bool push(Msg *msg) { queue.Enqueue(msg); return true; }
+    Msg *pop() { Msg *msg; return queue.Dequeue(msg) ? msg : nullptr; }
+    void finish() {}
+};
+
+struct MPSCIntrusiveAdapter {
+    static const char *name() { return "MPSCQueueIntrusive"; }
+    MPSCQueue<Msg, &Msg::link> queue;
+    bool push(Msg *msg) { queue.Enqueue(msg); return true; }
+    Msg *pop() { Msg *msg; return queue.Dequeue(msg) ? msg : nullptr; }
+    void finish() {}
+};
+
+struct SegmentedMPSCAdapter {
+    static const char *name() { return "SegmentedMPSCQueue"; }
+    SegmentedMPSCQueue<Msg*> queue;
+    bool push(Msg *msg) { queue.Enqueue(msg); return true; }
+    Msg *pop() { Msg *msg; return queue.Dequeue(msg) ? msg : nullptr; }
+    void finish() {}
+};
+
+struct SPSCAdapter {
+    static const char *name() { return "SPSCQueue"; }
+    SPSCQueue<Msg*> queue;
+    SPSCAdapter() : queue(BOUNDED_CAPACITY) {}
+    bool push(Msg *msg) { return queue.Enqueue(msg); }
+    Msg *pop() { Msg *msg; return queue.Dequeue(msg) ? msg : nullptr; }
+    void finish() {}
+};
+
+struct MPMCAdapter {
+    static const char *name() { return "MPMCQueue"; }
+    MPMCQueue<Msg*> queue;
+    MPMCAdapter() : queue(BOUNDED_CAPACITY) {}
+    bool push(Msg *msg) { return queue.try_push(msg); }
+    Msg *pop() { Msg *msg; return queue.try_pop(msg) ? msg : nullptr; }
+    void finish() {}
+};
+
+struct Options {
+    size_t messages = 200000;
+    int max_producers = 4;
+    int max_consumers = 4;
+    std::string only;
+    bool json = false;
+};
+
+struct Result {
+    const char *queue;
+    bool bounded;
+    int producers;
+    int consumers;
+    size_t payload;
+    size_t messages;
+    double ops_per_sec;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+};
+
+template<typename Adapter>
+static Result run(Adapter& adapter, bool bounded, int producers, int consumers, size_t payload, size_t messages) {
+    std::vector<std::thread> threads;
+    std::vector<std::vector<uint64_t>> latency(consumers);
+    std::atomic<size_t> remaining(messages);
+    std::atomic<int> ready(0);
+    std::atomic<bool> start(false);
+    // 每个生产者至少发一条，否则没有样本可统计
+    if (messages < (size_t)producers)
+        messages = producers;
+    size_t per_producer = messages / producers;
+    messages = per_producer * producers;
+    remaining = messages;
+
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            pin_thread(p);
+            ready++;
+            while (!start.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (size_t i = 0; i < per_producer; i++) {
+                Msg *msg = Msg::create(payload);
+                while (!adapter.push(msg))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&, c]() {
+            pin_thread(producers + c);
+            std::vector<uint64_t>& samples = latency[c];
+            samples.reserve(messages / consumers + 1);
+            ready++;
+            while (!start.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            while (remaining.load(std::memory_order_relaxed) > 0) {
+                Msg *msg = adapter.pop();
+                if (!msg) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                samples.push_back(now_ns() - msg->stamp);
+                // 读一遍负载，模拟真实消费
+                volatile char sink = msg->payload[payload - 1];
+                (void)sink;
+                Msg::destroy(msg);
+                // 最后一条消息被取走后放开可能阻塞在队列里的其它消费者
+                if (remaining.fetch_sub(1, std::memory_order_relaxed) == 1)
+                    adapter.finish();
+            }
+        });
+    }
+
+    while (ready.load() < producers + consumers)
+        std::this_thread::yield();
+    uint64_t begin = now_ns();
+    start.store(true, std::memory_order_release);
+    for (std::thread& t : threads)
+        t.join();
+    uint64_t elapsed = now_ns() - begin;
+
+    std::vector<uint64_t> all;
+    all.reserve(messages);
+    for (std::vector<uint64_t>& samples : latency)
+        all.insert(all.end(), samples.begin(), samples.end());
+    std::sort(all.begin(), all.end());
+
+    Result result;
+    result.queue = Adapter::name();
+    result.bounded = bounded;
+    result.producers = producers;
+    result.consumers = consumers;
+    result.payload = payload;
+    result.messages = messages;
+    result.ops_per_sec = messages * 1e9 / elapsed;
+    result.p50 = result.p99 = result.p999 = 0;
+    if (!all.empty()) {
+        result.p50 = all[all.size() / 2];
+        result.p99 = all[all.size() * 99 / 100];
+        result.p999 = all[all.size() * 999 / 1000];
+    }
+    return result;
+}
+
+static void print_header(const Options& opt) {
+    if (opt.json)
+        printf("[\n");
+    else
+        printf("queue,bounded,producers,consumers,payload,messages,ops_per_sec,p50_ns,p99_ns,p999_ns\n");
+}
+
+static void print_result(const Options& opt, const Result& r, bool first) {
+    if (opt.json)
+        printf("%s  {\"queue\": \"%s\", \"bounded\": %s, \"producers\": %d, \"consumers\": %d, \"payload\": %zu, "
+               "\"messages\": %zu, \"ops_per_sec\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}",
+               first ? "" : ",\n", r.queue, r.bounded ? "true" : "false", r.producers, r.consumers, r.payload,
+               r.messages, r.ops_per_sec, (unsigned long long)r.p50, (unsigned long long)r.p99, (unsigned long long)r.p999);
+    else
+        printf("%s,%d,%d,%d,%zu,%zu,%.0f,%llu,%llu,%llu\n", r.queue, r.bounded, r.producers, r.consumers, r.payload,
+               r.messages, r.ops_per_sec, (unsigned long long)r.p50, (unsigned long long)r.p99, (unsigned long long)r.p999);
+    fflush(stdout);
+}
+
+static void print_footer(const Options& opt) {
+    if (opt.json)
+        printf("\n]\n");
+}
+
+// 按队列允许的形状跑完整个矩阵
+template<typename Adapter, typename Factory>
+static void run_matrix(const Options& opt, bool bounded, int max_producers, int max_consumers, Factory factory, bool& first) {
+    static const size_t payloads[] = { 8, 64, 512, 4096 };
+
+    if (!opt.only.empty() && opt.only != Adapter::name())
+        return;
+
+    for (int producers = 1; producers <= max_producers; producers *= 2) {
+        for (int consumers = 1; consumers <= max_consumers; consumers *= 2) {
+            for (size_t payload : payloads) {
+                Adapter *adapter = factory();
+                Result r = run(*adapter, bounded, producers, consumers, payload, opt.messages);
+                delete adapter;
+                print_result(opt, r, first);
+                first = false;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--messages") && i + 1 < argc)
+            opt.messages = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--producers") && i + 1 < argc)
+            opt.max_producers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--consumers") && i + 1 < argc)
+            opt.max_consumers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--queue") && i + 1 < argc)
+            opt.only = argv[++i];
+        else if (!strcmp(argv[i], "--json"))
+            opt.json = true;
+        else {
+            fprintf(stderr, "usage: %s [--messages N] [--producers N] [--consumers N] [--queue NAME] [--json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bool first = true;
+    print_header(opt);
+    run_matrix<LockedAdapter>(opt, false, opt.max_producers, opt.max_consumers, []() { return new LockedAdapter; }, first);
+    run_matrix<ProducerConsumerAdapter>(opt, false, opt.max_producers, opt.max_consumers, []() { return new ProducerConsumerAdapter; }, first);
+    run_matrix<MsgQueueAdapter>(opt, false, opt.max_producers, opt.max_consumers, []() { return new MsgQueueAdapter(false); }, first);
+    run_matrix<MsgQueueAdapter>(opt, true, opt.max_producers, opt.max_consumers, []() { return new MsgQueueAdapter(true); }, first);
+    run_matrix<MPSCAdapter>(opt, false, opt.max_producers, 1, []() { return new MPSCAdapter; }, first);
+    run_matrix<MPSCIntrusiveAdapter>(opt, false, opt.max_producers, 1, []() { return new MPSCIntrusiveAdapter; }, first);
+    run_matrix<SegmentedMPSCAdapter>(opt, false, opt.max_producers, 1, []() { return new SegmentedMPSCAdapter; }, first);
+    run_matrix<SPSCAdapter>(opt, true, 1, 1, []() { return new SPSCAdapter; }, first);
+    run_matrix<MPMCAdapter>(opt, true, opt.max_producers, opt.max_consumers, []() { return new MPMCAdapter; }, first);
+    print_footer(opt);
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "BroadcastRing.h"
+#include "LockedQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// 三个消费者（日志、统计、复制）都要看到每一条消息，复制必须在日志处理之后：
+//   现在的做法：每个消费者一个 LockedQueue，生产者把每条消息拷贝三份；
+//   BroadcastRing：消息只写一次，三个消费者原地读取，复制依赖日志的游标。
+// 每个消费者校验收到的条数和总和。
+#define MESSAGES 1000000
+#define RING_SIZE 4096
+
+typedef std::chrono::steady_clock Clock;
+
+struct Msg {
+    int64_t id = 0;
+    char payload[56] = {0};
+};
+
+static long long elapsed_ms(Clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begin).count();
+}
+
+static void check(const char *name, const int64_t sums[3], int64_t expect) {
+    bool ok = sums[0] == expect && sums[1] == expect && sums[2] == expect;
+    std::cout << "  " << name << (ok ? " ok" : " sum mismatch") << std::endl;
+}
+
+static void run_locked() {
+    LockedQueue<Msg> queues[3];
+    int64_t sums[3] = {0, 0, 0};
+    Clock::time_point begin = Clock::now();
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < 3; c++) {
+        consumers.emplace_back([&, c]() {
+            Msg msg;
+            for (int i = 0; i < MESSAGES;) {
+                if (queues[c].next(msg)) {
+                    sums[c] += msg.id;
+                    i++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    Msg msg;
+    for (int i = 0; i < MESSAGES; i++) {
+        msg.id = i;
+        for (LockedQueue<Msg>& queue : queues)
+            queue.add(msg);
+    }
+    for (std::thread& t : consumers)
+        t.join();
+    std::cout << "LockedQueue per consumer: " << elapsed_ms(begin) << " ms" << std::endl;
+    check("LockedQueue", sums, (int64_t)MESSAGES * (MESSAGES - 1) / 2);
+}
+
+template<BroadcastProducer Producer>
+static void run_ring(const char *name, int producers) {
+    typedef BroadcastRing<Msg, Producer> Ring;
+    Ring ring(RING_SIZE);
+    typename Ring::Consumer *logger = ring.AddConsumer();
+    typename Ring::Consumer *metrics = ring.AddConsumer();
+    typename Ring::Consumer *replicator = ring.AddConsumer({logger});
+    typename Ring::Consumer *cursors[3] = {logger, metrics, replicator};
+
+    int64_t sums[3] = {0, 0, 0};
+    std::atomic<bool> ordered(true);
+    Clock::time_point begin = Clock::now();
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < 3; c++) {
+        consumers.emplace_back([&, c]() {
+            for (int64_t seen = 0; seen < MESSAGES;) {
+                seen += ring.PollWait(cursors[c], [&](const Msg& msg, int64_t seq, bool) {
+                    sums[c] += msg.id;
+                    if (c == 2 && logger->Sequence() < seq)
+                        ordered = false;
+                });
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int p = 0; p < producers; p++) {
+        writers.emplace_back([&, p]() {
+            for (int i = p; i < MESSAGES; i += producers) {
+                int64_t seq = ring.Claim();
+                ring[seq].id = i;
+                ring.Publish(seq);
+            }
+        });
+    }
+    for (std::thread& t : writers)
+        t.join();
+    for (std::thread& t : consumers)
+        t.join();
+    std::cout << name << ": " << elapsed_ms(begin) << " ms" << std::endl;
+    check(name, sums, (int64_t)MESSAGES * (MESSAGES - 1) / 2);
+    std::cout << "  replicator " << (ordered ? "always behind" : "ran ahead of") << " logger" << std::endl;
+}
+
+int main() {
+    run_locked();
+    run_ring<BroadcastProducer::Single>("BroadcastRing single producer", 1);
+    run_ring<BroadcastProducer::Multi>("BroadcastRing 2 producers", 2);
+    return 0;
+}
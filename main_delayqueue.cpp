@@ -0,0 +1,148 @@
+#include "msgqueue.h"
+#include "DelayQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// 延迟投递：4 个生产者各调度 MESSAGES / 4 条随机延迟 0~MAX_DELAY_MS 的消息，
+// 消费者阻塞等待，统计提前投递的条数（应当为 0）和平均/最大延后时间。
+// 另外对比调度开销：msgqueue_put_at 和"加锁的 std::multimap 按时间排序"的插入耗时。
+#define MESSAGES 200000
+#define MAX_DELAY_MS 500
+
+typedef std::chrono::steady_clock Clock;
+
+struct Timer {
+    explicit Timer(int _v = 0) : v(_v), next(nullptr), deadline(0) {}
+    int v;
+    void *next;                          // msgqueue 的链接
+    unsigned long long deadline;         // msgqueue_put_at 存截止时间的位置，见 msgqueue_set_deadline_offset
+    Clock::time_point due;
+};
+
+struct DelayedTimer {
+    int v;
+    std::atomic<DelayedTimer *> link;
+    Clock::time_point due;
+};
+
+static long long ns_of(Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+struct Lateness {
+    long long early = 0, total_us = 0, max_us = 0, count = 0;
+    void add(Clock::time_point due) {
+        long long us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due).count();
+        if (us < 0)
+            early++;
+        total_us += us;
+        max_us = std::max(max_us, us);
+        count++;
+    }
+    void print(const char *name) const {
+        std::cout << name << ": " << count << " delivered, " << early << " early, late avg "
+                  << total_us / std::max(count, 1LL) << " us, max " << max_us << " us" << std::endl;
+    }
+};
+
+template<typename Schedule>
+static void produce(Schedule schedule) {
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; p++) {
+        producers.emplace_back([p, &schedule]() {
+            std::mt19937 rng(p);
+            std::uniform_int_distribution<int> delay(0, MAX_DELAY_MS * 1000);
+            for (int i = 0; i < MESSAGES / 4; i++)
+                schedule(Clock::now() + std::chrono::microseconds(delay(rng)));
+        });
+    }
+    for (std::thread& t : producers)
+        t.join();
+}
+
+int main() {
+    // 调度开销：单线程插入 MESSAGES 条
+    {
+        std::vector<Timer> timers(MESSAGES);
+        msgqueue_t *queue = msgqueue_create(MESSAGES, offsetof(Timer, next));
+        msgqueue_set_deadline_offset(queue, offsetof(Timer, deadline));
+        Clock::time_point far = Clock::now() + std::chrono::hours(1);
+        Clock::time_point begin = Clock::now();
+        for (int i = 0; i < MESSAGES; i++)
+            msgqueue_put_at(&timers[i], ns_of(far + std::chrono::microseconds(i)), queue);
+        long long wheel_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+        msgqueue_destroy(queue);
+
+        std::mutex lock;
+        std::multimap<Clock::time_point, Timer *> sorted;
+        begin = Clock::now();
+        for (int i = 0; i < MESSAGES; i++) {
+            std::lock_guard<std::mutex> guard(lock);
+            sorted.emplace(far + std::chrono::microseconds(i), &timers[i]);
+        }
+        long long map_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+        std::cout << "schedule: msgqueue_put_at " << wheel_ns / MESSAGES << " ns/op, locked multimap "
+                  << map_ns / MESSAGES << " ns/op" << std::endl;
+    }
+
+    // 空队列上阻塞的消费者应当在截止时间醒来
+    {
+        msgqueue_t *queue = msgqueue_create(16, offsetof(Timer, next));
+        msgqueue_set_deadline_offset(queue, offsetof(Timer, deadline));
+        Timer timer;
+        timer.due = Clock::now() + std::chrono::milliseconds(50);
+        msgqueue_put_at(&timer, ns_of(timer.due), queue);
+        msgqueue_get(queue);
+        Lateness late;
+        late.add(timer.due);
+        late.print("single put_at +50ms");
+        msgqueue_destroy(queue);
+    }
+
+    {
+        msgqueue_t *queue = msgqueue_create(1024, offsetof(Timer, next));
+        msgqueue_set_deadline_offset(queue, offsetof(Timer, deadline));
+        Lateness late;
+        std::thread cs([&]() {
+            for (int i = 0; i < MESSAGES; i++) {
+                Timer *timer = (Timer *)msgqueue_get(queue);
+                late.add(timer->due);
+                delete timer;
+            }
+        });
+        produce([&](Clock::time_point due) {
+            Timer *timer = new Timer();
+            timer->due = due;
+            msgqueue_put_at(timer, ns_of(due), queue);
+        });
+        cs.join();
+        late.print("msgqueue_put_at");
+        msgqueue_destroy(queue);
+    }
+
+    {
+        DelayQueue<DelayedTimer, &DelayedTimer::link, &DelayedTimer::due> queue;
+        Lateness late;
+        std::thread cs([&]() {
+            for (int i = 0; i < MESSAGES; i++) {
+                DelayedTimer *timer;
+                queue.DequeueWait(timer);
+                late.add(timer->due);
+                delete timer;
+            }
+        });
+        produce([&](Clock::time_point due) { queue.Enqueue(new DelayedTimer(), due); });
+        cs.join();
+        late.print("DelayQueue");
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "CacheLine.h"
+#include "MPSCQueue.h"
+#include "MPSCNodePool.h"
+#include "msgqueue.h"
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include<sys/time.h>
+#include <iostream>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+// 生产者端和消费者端字段分开放置前后的对比。同一份代码编译两次：
+//   gcc -O2 -c msgqueue.c && g++ -std=c++17 -O2 main_falsesharing.cpp msgqueue.o -pthread -o padded
+//   gcc -O2 -DMARK_CACHE_LINE_SIZE=8 -c msgqueue.c && g++ -std=c++17 -O2 -DMARK_CACHE_LINE_SIZE=8 main_falsesharing.cpp msgqueue.o -pthread -o packed
+// packed 版本的对齐退化成指针大小，相当于各字段紧挨着放置。
+// 跨 NUMA 节点时差距最明显，可以用 numactl 把生产者和消费者放到不同的 socket 上运行。
+#define PER_PRODUCER 1000000
+
+struct Count {
+    Count(int _v) : v(_v), next(nullptr) {}
+    int v;
+    Count *next;
+};
+
+// producers 个生产者，一个消费者，返回取完全部消息的耗时(ms)
+template<typename Produce, typename Consume>
+static int run(int producers, Produce produce, Consume consume) {
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    std::vector<std::thread> threads;
+    for(int p=0;p<producers;p++){
+        threads.emplace_back([&]() {
+            for(int i=0;i<PER_PRODUCER;i++){
+                produce(i);
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        for(int i=0;i<producers * PER_PRODUCER;){
+            if(consume())
+                i++;
+            else
+                std::this_thread::yield();
+        }
+    });
+    for(std::thread& t : threads){
+        t.join();
+    }
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main() {
+    int cores = std::thread::hardware_concurrency();
+    if(cores < 2)
+        cores = 2;
+
+    std::cout << "cache line " << CacheLineSize << ", sizeof(MPSCQueue) "
+              << sizeof(MPSCQueueNonIntrusive<Count, MPSCNodePool>) << std::endl;
+
+    for(int producers=1;producers<cores;producers*=2){
+        MPSCQueueNonIntrusive<Count, MPSCNodePool> mpsc;
+        Count count(0);
+        int mpscMs = run(producers, [&](int) { mpsc.Enqueue(&count); },
+                         [&]() { Count *ele; return mpsc.Dequeue(ele); });
+
+        msgqueue_t *queue = msgqueue_create(4096, offsetof(Count, next));
+        int msgMs = run(producers, [&](int i) { msgqueue_put(new Count(i), queue); },
+                        [&]() { delete (Count *)msgqueue_get(queue); return true; });
+        msgqueue_destroy(queue);
+
+        std::cout << producers << " producers: MPSCQueue " << mpscMs << " ms, msgqueue " << msgMs << " ms" << std::endl;
+    }
+
+    return 0;
+}
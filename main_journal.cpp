@@ -0,0 +1,154 @@
+#include "msgqueue.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <iostream>
+
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// 日志模式的开销和重启恢复：
+//   1. 两个生产者一个消费者，对比不开日志、开日志（后台成组刷盘）、生产者每 1000 条 sync 一次、每条都 sync；
+//   2. 子进程入队后只消费一部分、提交、sync，然后直接 _exit 模拟崩溃，父进程重新打开日志，
+//      检查恢复出来的正好是没有提交的那些消息。
+#define MESSAGES 200000
+#define SYNC_EVERY 1000
+#define SYNC_MESSAGES 2000   // 每条都 sync 太慢，只跑这么多条
+#define SEGMENT_SIZE (4 << 20)
+
+struct Record {
+    Record(long _seq) : seq(_seq), next(nullptr) {}
+    long seq;
+    Record *next;
+    char payload[48];
+};
+
+static size_t record_size(const void *) {
+    return sizeof(Record);
+}
+
+static void *record_restore(const void *data, size_t size, void *) {
+    if (size != sizeof(Record))
+        return nullptr;
+    Record *r = new Record(0);
+    memcpy(r, data, size);
+    return r;
+}
+
+static msgqueue_t *open_queue(const std::string& dir, long *restored) {
+    msgqueue_t *queue = msgqueue_create(1024, offsetof(Record, next));
+    long n = msgqueue_open_journal(queue, dir.c_str(), SEGMENT_SIZE, 0, record_size, record_restore, nullptr);
+    if (n < 0) {
+        perror("msgqueue_open_journal");
+        exit(1);
+    }
+    if (restored)
+        *restored = n;
+    return queue;
+}
+
+static void clear_dir(const std::string& dir) {
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent *e = readdir(d)) {
+        if (e->d_name[0] != '.')
+            unlink((dir + "/" + e->d_name).c_str());
+    }
+    closedir(d);
+}
+
+// mode：0 不开日志，1 只靠后台刷盘，2 每 SYNC_EVERY 条 sync 一次，3 每条都 sync。返回每条消息的平均耗时(ns)
+static double run(const std::string& dir, int mode, long messages) {
+    clear_dir(dir);
+    msgqueue_t *queue = mode ? open_queue(dir, nullptr) : msgqueue_create(1024, offsetof(Record, next));
+    auto begin = std::chrono::steady_clock::now();
+
+    auto produce = [&]() {
+        for (long i = 0; i < messages / 2; i++) {
+            msgqueue_put(new Record(i), queue);
+            if ((mode == 2 && i % SYNC_EVERY == SYNC_EVERY - 1) || mode == 3)
+                msgqueue_journal_sync(queue);
+        }
+    };
+    std::thread pd1(produce);
+    std::thread pd2(produce);
+
+    std::thread cs([&]() {
+        for (long i = 0; i < messages; i++) {
+            delete (Record *)msgqueue_get(queue);
+            if (mode && i % SYNC_EVERY == SYNC_EVERY - 1)
+                msgqueue_journal_commit(queue);
+        }
+    });
+
+    pd1.join();
+    pd2.join();
+    cs.join();
+    long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    msgqueue_destroy(queue);
+    return (double)ns / messages;
+}
+
+// 子进程：入队 total 条，消费 consumed 条后提交并 sync，然后不做清理直接退出
+static void crash_after(const std::string& dir, long total, long consumed) {
+    msgqueue_t *queue = open_queue(dir, nullptr);
+    msgqueue_set_nonblock(queue);
+    for (long i = 0; i < total; i++)
+        msgqueue_put(new Record(i), queue);
+    for (long i = 0; i < consumed; i++)
+        delete (Record *)msgqueue_get(queue);
+    msgqueue_journal_commit(queue);
+    msgqueue_journal_sync(queue);
+    _exit(0);
+}
+
+int main() {
+    char tmpl[] = "/tmp/msgjournal.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = tmpl;
+
+    std::cout << "no journal: " << run(dir, 0, MESSAGES) << " ns/msg" << std::endl;
+    std::cout << "journal, background flush: " << run(dir, 1, MESSAGES) << " ns/msg" << std::endl;
+    std::cout << "journal, sync every " << SYNC_EVERY << ": " << run(dir, 2, MESSAGES) << " ns/msg" << std::endl;
+    std::cout << "journal, sync every put: " << run(dir, 3, SYNC_MESSAGES) << " ns/msg" << std::endl;
+
+    // 崩溃后恢复
+    const long total = 10000, consumed = 4000;
+    clear_dir(dir);
+    pid_t pid = fork();
+    if (pid == 0)
+        crash_after(dir, total, consumed);
+    waitpid(pid, nullptr, 0);
+
+    long restored;
+    msgqueue_t *queue = open_queue(dir, &restored);
+    msgqueue_set_nonblock(queue);
+    long expect = consumed;
+    bool ordered = true;
+    while (Record *r = (Record *)msgqueue_get(queue)) {
+        ordered = ordered && r->seq == expect++;
+        delete r;
+    }
+    msgqueue_journal_commit(queue);
+    msgqueue_destroy(queue);
+    std::cout << "restart: restored " << restored << " of " << total - consumed
+              << (ordered && expect == total ? ", in order" : ", WRONG") << std::endl;
+
+    // 全部提交后再打开，不应再有消息
+    queue = open_queue(dir, &restored);
+    msgqueue_destroy(queue);
+    std::cout << "after full commit: restored " << restored << std::endl;
+
+    clear_dir(dir);
+    rmdir(dir.c_str());
+    return 0;
+}
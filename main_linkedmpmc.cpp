@@ -0,0 +1,211 @@
+#include "LinkedMPMCQueue.h"
+#include "LockedQueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/time.h>
+#include <iostream>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+// LinkedMPMCQueue 的压力测试，危险指针和 epoch 两种回收各跑一遍：
+//   1. 两生产者两消费者，每条消息带校验字段，析构时被涂掉，读到已经回收复用的节点就会校验失败；
+//      每个消费者看到的同一生产者的序号必须递增，每条消息恰好收到一次；
+//   2. 令牌循环：少量令牌在几乎为空的队列里被各线程反复取出又放回，节点刚回收就被复用，
+//      头指针的 CAS 最容易遇到 ABA，任何令牌同时被两个线程拿到或丢失都算错误；
+//   3. 与 LockedQueue 对比吞吐。
+// 带 --unsafe 参数时额外用一个摘下就立即复用节点的“回收域”跑一遍，演示测试能发现的错误。
+#define PRODUCERS 2
+#define CONSUMERS 2
+#define PER_PRODUCER 500000
+#define TOKENS 4
+#define TOKEN_THREADS 4
+#define TOKEN_ROUNDS 500000
+
+struct Payload {
+    Payload() : producer(0), seq(0), check(0) {}
+    Payload(uint32_t _producer, uint32_t _seq) : producer(_producer), seq(_seq), check(Check(_producer, _seq)) {}
+    ~Payload() { check = 0xdeaddeaddeaddeadULL; }
+
+    static uint64_t Check(uint32_t producer, uint32_t seq) {
+        return ((uint64_t)producer << 32 | seq) * 0x9e3779b97f4a7c15ULL + 1;
+    }
+    bool Valid() const { return check == Check(producer, seq); }
+
+    uint32_t producer;
+    uint32_t seq;
+    uint64_t check;
+};
+
+// 不做任何保护、摘下就复用节点，只用来验证测试本身
+class ImmediateReclaim {
+public:
+    typedef void (*Dispose)(void* context, void* p);
+    ImmediateReclaim(Dispose dispose, void* context) : _dispose(dispose), _context(context) {}
+
+    class Guard {
+    public:
+        explicit Guard(ImmediateReclaim& domain) : _domain(domain) {}
+        template<typename T>
+        T* Protect(int, const std::atomic<T*>& src) { return src.load(std::memory_order_acquire); }
+        void Retire(void* p) { _domain._dispose(_domain._context, p); }
+    private:
+        ImmediateReclaim& _domain;
+    };
+
+private:
+    Dispose _dispose;
+    void* _context;
+};
+
+template<typename Reclaimer>
+long stress_fifo(int& ms) {
+    LinkedMPMCQueue<Payload, Reclaimer> queue;
+    std::vector<std::atomic<uint8_t>> seen(PRODUCERS * PER_PRODUCER);
+    for (auto& s : seen)
+        s.store(0, std::memory_order_relaxed);
+    std::atomic<long> remaining(PRODUCERS * PER_PRODUCER);
+    std::atomic<long> errors(0);
+
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCERS; p++) {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < PER_PRODUCER; i++)
+                queue.Emplace(p, i);
+        });
+    }
+    for (int c = 0; c < CONSUMERS; c++) {
+        threads.emplace_back([&]() {
+            long last[PRODUCERS];
+            for (int p = 0; p < PRODUCERS; p++)
+                last[p] = -1;
+            Payload msg;
+            while (remaining.load(std::memory_order_relaxed) > 0) {
+                if (!queue.Dequeue(msg)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                remaining.fetch_sub(1, std::memory_order_relaxed);
+                if (!msg.Valid() || msg.producer >= PRODUCERS || msg.seq >= PER_PRODUCER) {
+                    errors++;
+                    continue;
+                }
+                if ((long)msg.seq <= last[msg.producer])
+                    errors++;   // 同一生产者的消息乱序
+                last[msg.producer] = msg.seq;
+                if (seen[msg.producer * PER_PRODUCER + msg.seq].exchange(1))
+                    errors++;   // 重复收到
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+    ms = TIME_SUB_MS(tv_end, tv_begin);
+
+    for (auto& s : seen) {
+        if (!s.load(std::memory_order_relaxed))
+            errors++;   // 丢失
+    }
+    return errors.load();
+}
+
+template<typename Reclaimer>
+long stress_tokens() {
+    LinkedMPMCQueue<int, Reclaimer> queue;
+    std::atomic<bool> inQueue[TOKENS];
+    for (int t = 0; t < TOKENS; t++) {
+        inQueue[t].store(true);
+        queue.Enqueue(t);
+    }
+    std::atomic<long> errors(0);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < TOKEN_THREADS; i++) {
+        threads.emplace_back([&]() {
+            int token;
+            for (int round = 0; round < TOKEN_ROUNDS; round++) {
+                if (!queue.Dequeue(token))
+                    continue;
+                if (token < 0 || token >= TOKENS || !inQueue[token].exchange(false)) {
+                    errors++;   // 不存在的令牌，或者同一个令牌被取出了两次
+                    continue;
+                }
+                inQueue[token].store(true);
+                queue.Enqueue(token);
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    int token, count = 0;
+    while (queue.Dequeue(token))
+        count++;
+    return errors.load() + (count > TOKENS ? count - TOKENS : TOKENS - count);
+}
+
+template<typename Reclaimer>
+void run(const char* name) {
+    int ms;
+    long fifoErrors = stress_fifo<Reclaimer>(ms);
+    long tokenErrors = stress_tokens<Reclaimer>();
+    std::cout << name << ": " << ms << " ms, fifo errors " << fifoErrors << ", token errors " << tokenErrors << std::endl;
+}
+
+int locked_queue() {
+    LockedQueue<Payload> queue;
+    std::atomic<long> remaining(PRODUCERS * PER_PRODUCER);
+
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCERS; p++) {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < PER_PRODUCER; i++)
+                queue.emplace(p, i);
+        });
+    }
+    for (int c = 0; c < CONSUMERS; c++) {
+        threads.emplace_back([&]() {
+            Payload msg;
+            while (remaining.load(std::memory_order_relaxed) > 0) {
+                if (queue.next(msg))
+                    remaining.fetch_sub(1, std::memory_order_relaxed);
+                else
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+    return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main(int argc, char** argv) {
+    std::cout << "LockedQueue: " << locked_queue() << " ms" << std::endl;
+    run<HazardPointerDomain<2>>("LinkedMPMCQueue<hazard pointers>");
+    run<EpochDomain>("LinkedMPMCQueue<epoch>");
+
+    if (argc > 1 && strcmp(argv[1], "--unsafe") == 0)
+        run<ImmediateReclaim>("LinkedMPMCQueue<no reclamation>");
+
+    // 只能移动的元素
+    LinkedMPMCQueue<std::unique_ptr<int>> queue;
+    queue.Enqueue(std::unique_ptr<int>(new int(42)));
+    std::unique_ptr<int> out;
+    std::cout << "unique_ptr: " << (queue.Dequeue(out) && *out == 42 ? "ok" : "WRONG") << std::endl;
+    return 0;
+}
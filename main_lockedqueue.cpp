@@ -1,7 +1,50 @@
 #include"LockedQueue.h"
+#include"SpinLock.h"
 #include<chrono>
 #include<thread>
 #include<iostream>
+#include<sys/time.h>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+#define PER_PRODUCER 1000000
+
+//同样两个生产者、两个消费者的场景，放大消息数量，比较不同锁的耗时(ms)
+template<class Lock>
+int run(){
+    LockedQueue<int,std::deque<int>,Lock> queue;
+    struct timeval tv_begin;
+    gettimeofday(&tv_begin, NULL);
+
+    std::thread pd1([&]{
+        for(int i=0;i<PER_PRODUCER;i++){
+            queue.add(i);
+        }
+    });
+    std::thread pd2([&]{
+        for(int i=0;i<PER_PRODUCER;i++){
+            queue.add(i);
+        }
+    });
+    pd1.join();
+    pd2.join();
+
+    std::thread cs1([&]() {
+        int ele;
+        while(queue.next(ele))
+            ;
+    });
+    std::thread cs2([&]() {
+        int ele;
+        while(queue.next(ele))
+            ;
+    });
+    cs1.join();
+    cs2.join();
+
+    struct timeval tv_end;
+    gettimeofday(&tv_end, NULL);
+    return TIME_SUB_MS(tv_end, tv_begin);
+}
 
 int main(){
     LockedQueue<int> queue;
@@ -41,5 +84,9 @@ int main(){
     cs1.join();
     cs2.join();
 
+    std::cout << "std::mutex " << run<std::mutex>() << " ms" << std::endl;
+    std::cout << "TicketSpinLock " << run<TicketSpinLock>() << " ms" << std::endl;
+    std::cout << "SpinFutexLock " << run<SpinFutexLock>() << " ms" << std::endl;
+
     return 0;
-}
\ No newline at end of file
+}
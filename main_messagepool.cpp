@@ -0,0 +1,207 @@
+#include "MessagePool.h"
+#include "MPSCQueue.h"
+#include "msgqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// 消息用 new/delete 和用 MessagePool 的对比：msgqueue 和侵入式 MPSCQueue 各跑一遍，
+// 两个生产者、一个消费者，输出耗时、堆分配次数，以及分配（生产者）和释放（消费者）单次耗时的 p50/p99
+#define PRODUCERS 2
+#define PER_PRODUCER 500000
+
+// 统计全局 new 的次数，包括池申请 slab 用的对齐版本
+static std::atomic<long> allocations(0);
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t alignment = static_cast<size_t>(align);
+    // aligned_alloc 要求大小是对齐的整数倍
+    void *p = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    free(p);
+}
+
+struct Message {
+    Message(int _producer, int _seq) : producer(_producer), seq(_seq) {}
+    int producer;
+    int seq;
+    std::atomic<Message*> next; // msgqueue 的 linkoff、MPSCQueue 和 MessagePool 共用这一个链接
+    char payload[48];
+};
+
+// msgqueue 对 linkoff 处的指针做普通读写
+static_assert(sizeof(std::atomic<Message*>) == sizeof(void*), "link must be pointer sized");
+
+struct HeapAllocator {
+    Message* Allocate(int producer, int seq) { return new Message(producer, seq); }
+    void Free(Message* msg) { delete msg; }
+};
+
+typedef MessagePool<Message, &Message::next> PoolAllocator;
+
+struct Result {
+    long ms;
+    long allocations;
+    std::vector<uint32_t> allocNs;
+    std::vector<uint32_t> freeNs;
+};
+
+static uint32_t since(std::chrono::steady_clock::time_point begin) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+}
+
+struct MsgqueueChannel {
+    msgqueue_t* queue;
+    MsgqueueChannel() : queue(msgqueue_create(1024, offsetof(Message, next))) {}
+    ~MsgqueueChannel() { msgqueue_destroy(queue); }
+    void Put(Message* msg) { msgqueue_put(msg, queue); }
+    Message* Get() { return (Message*)msgqueue_get(queue); }
+};
+
+struct MPSCChannel {
+    MPSCQueue<Message, &Message::next> queue;
+    void Put(Message* msg) { queue.Enqueue(msg); }
+    Message* Get() {
+        Message* msg;
+        while(!queue.Dequeue(msg))
+            std::this_thread::yield();
+        return msg;
+    }
+};
+
+// 每条消息都计时分配和释放两步，队列操作本身不计入
+template<typename Channel, typename Allocator>
+static Result run(Allocator& allocator) {
+    Channel channel;
+    Result result;
+    std::vector<std::vector<uint32_t>> allocNs(PRODUCERS, std::vector<uint32_t>(PER_PRODUCER));
+    result.freeNs.resize(PRODUCERS * PER_PRODUCER);
+
+    long before = allocations.load();
+    auto begin = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> producers;
+    for(int p=0;p<PRODUCERS;p++){
+        producers.emplace_back([&, p]() {
+            std::vector<uint32_t>& samples = allocNs[p];
+            for(int i=0;i<PER_PRODUCER;i++){
+                auto t = std::chrono::steady_clock::now();
+                Message* msg = allocator.Allocate(p, i);
+                samples[i] = since(t);
+                channel.Put(msg);
+            }
+        });
+    }
+
+    std::thread consumer([&]() {
+        for(int i=0;i<PRODUCERS * PER_PRODUCER;i++){
+            Message* msg = channel.Get();
+            auto t = std::chrono::steady_clock::now();
+            allocator.Free(msg);
+            result.freeNs[i] = since(t);
+        }
+    });
+
+    for(auto& t : producers)
+        t.join();
+    consumer.join();
+
+    result.ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    result.allocations = allocations.load() - before; // 包括线程对象、池的登记表和 slab
+    for(auto& samples : allocNs)
+        result.allocNs.insert(result.allocNs.end(), samples.begin(), samples.end());
+    return result;
+}
+
+// slabs 是其中池申请的 slab 数，每个 slab 放 256 个对象
+static void print(const char* name, Result r, uint64_t slabs = 0) {
+    std::sort(r.allocNs.begin(), r.allocNs.end());
+    std::sort(r.freeNs.begin(), r.freeNs.end());
+    std::cout << name << ": " << r.ms << " ms, " << r.allocations << " allocations (" << slabs << " slabs)"
+              << ", alloc p50 " << r.allocNs[r.allocNs.size() / 2] << " ns p99 " << r.allocNs[r.allocNs.size() * 99 / 100] << " ns"
+              << ", free p50 " << r.freeNs[r.freeNs.size() / 2] << " ns p99 " << r.freeNs[r.freeNs.size() * 99 / 100] << " ns"
+              << std::endl;
+}
+
+int main() {
+    {
+        HeapAllocator heap;
+        print("msgqueue new/delete", run<MsgqueueChannel>(heap));
+    }
+
+    {
+        PoolAllocator pool;
+        Result r = run<MsgqueueChannel>(pool);
+        print("msgqueue pool", r, pool.Slabs());
+    }
+
+    {
+        HeapAllocator heap;
+        print("MPSCQueue new/delete", run<MPSCChannel>(heap));
+    }
+
+    {
+        PoolAllocator pool;
+        Result r = run<MPSCChannel>(pool);
+        print("MPSCQueue pool", r, pool.Slabs());
+    }
+
+    // 线程退出后，归还给它的缓存的对象能被其它线程重新用上，不需要新的 slab：
+    // 主线程先有自己的缓存，另一个线程切满一个 slab 后退出，主线程释放这些对象，
+    // 再分配两个 slab 的量，应当只用到这两个已有的 slab
+    {
+        PoolAllocator pool;
+        pool.Free(pool.Allocate(0, 0));
+        std::vector<Message*> msgs;
+        std::thread([&]() {
+            for(int i=0;i<256;i++)
+                msgs.push_back(pool.Allocate(1, i));
+        }).join();
+        for(Message* msg : msgs)
+            pool.Free(msg);
+
+        msgs.clear();
+        for(int i=0;i<512;i++)
+            msgs.push_back(pool.Allocate(0, i));
+        std::cout << "after thread exit: 512 objects from " << pool.Slabs() << " slabs" << std::endl;
+        for(Message* msg : msgs)
+            pool.Free(msg);
+    }
+
+    return 0;
+}
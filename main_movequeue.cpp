@@ -0,0 +1,88 @@
+#include "LockedQueue.h"
+#include "ProducerConsumerQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// 大消息分别以拷贝和移动方式入队，比较 add/Push 的平均耗时（锁内拷贝会直接拉长临界区）
+#define PER_PRODUCER 100000
+#define MSG_SIZE 4096
+
+typedef std::chrono::steady_clock Clock;
+
+struct Msg {
+    explicit Msg(int _v = 0) : v(_v), data(MSG_SIZE, 'x') {}
+    int v;
+    std::vector<char> data;
+};
+
+// 两个生产者一个消费者，返回生产者每次入队调用的平均耗时(ns)
+template<typename Push, typename Pop>
+long long run(Push push, Pop pop) {
+    std::atomic<long long> push_ns(0);
+    auto produce = [&]() {
+        long long used = 0;
+        for(int i=0;i<PER_PRODUCER;i++){
+            Msg msg(i);
+            Clock::time_point begin = Clock::now();
+            push(msg);
+            used += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+        }
+        push_ns += used;
+    };
+
+    std::thread pd1(produce);
+    std::thread pd2(produce);
+    std::thread cs1([&]() {
+        Msg msg;
+        for(int i=0;i<2 * PER_PRODUCER;){
+            if(pop(msg))
+                i++;
+            else
+                std::this_thread::yield();
+        }
+    });
+
+    pd1.join();
+    pd2.join();
+    cs1.join();
+    return push_ns / (2 * PER_PRODUCER);
+}
+
+int main() {
+    {
+        LockedQueue<Msg> queue;
+        auto pop = [&](Msg& msg) { return queue.next(msg); };
+        std::cout << "LockedQueue copy: " << run([&](Msg& msg) { queue.add(msg); }, pop) << " ns/add" << std::endl;
+        std::cout << "LockedQueue move: " << run([&](Msg& msg) { queue.add(std::move(msg)); }, pop) << " ns/add" << std::endl;
+    }
+
+    {
+        ProducerConsumerQueue<Msg> queue;
+        auto pop = [&](Msg& msg) { return queue.Pop(msg); };
+        std::cout << "ProducerConsumerQueue copy: " << run([&](Msg& msg) { queue.Push(msg); }, pop) << " ns/push" << std::endl;
+        std::cout << "ProducerConsumerQueue move: " << run([&](Msg& msg) { queue.Push(std::move(msg)); }, pop) << " ns/push" << std::endl;
+    }
+
+    // 只能移动的类型
+    LockedQueue<std::unique_ptr<Msg>> locked;
+    locked.add(std::unique_ptr<Msg>(new Msg(1)));
+    locked.emplace(new Msg(2));
+    std::unique_ptr<Msg> msg;
+    while(locked.next(msg)) {
+        std::cout << "LockedQueue pop " << msg->v << std::endl;
+    }
+
+    ProducerConsumerQueue<std::unique_ptr<Msg>> pcq;
+    pcq.Push(std::unique_ptr<Msg>(new Msg(3)));
+    pcq.Emplace(new Msg(4));
+    while(pcq.Pop(msg)) {
+        std::cout << "ProducerConsumerQueue pop " << msg->v << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "MPMCQueue.h"
+#include "LockedQueue.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <sys/time.h>
+#include <iostream>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+// 与 main_lockedqueue 相同的两生产者两消费者结构，消息数加大后比较两种队列
+#define PER_PRODUCER 1000000
+
+template<typename Queue>
+int run(Queue& queue) {
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    std::atomic<int> remaining(2 * PER_PRODUCER);
+    auto produce = [&]() {
+        for(int i=0;i<PER_PRODUCER;i++){
+            queue.add(i);
+        }
+    };
+    auto consume = [&]() {
+        int ele;
+        while(remaining.load(std::memory_order_relaxed) > 0) {
+            if(queue.next(ele))
+                remaining.fetch_sub(1, std::memory_order_relaxed);
+            else
+                std::this_thread::yield();
+        }
+    };
+
+    std::thread pd1(produce);
+    std::thread pd2(produce);
+    std::thread cs1(consume);
+    std::thread cs2(consume);
+
+    pd1.join();
+    pd2.join();
+    cs1.join();
+    cs2.join();
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main() {
+    {
+        LockedQueue<int> queue;
+        std::cout << "LockedQueue: " << run(queue) << std::endl;
+    }
+
+    {
+        MPMCQueue<int> queue(1024);
+        std::cout << "MPMCQueue: " << run(queue) << std::endl;
+    }
+
+    // 只能移动的类型
+    MPMCQueue<std::unique_ptr<int>> queue(4);
+    queue.try_push(std::unique_ptr<int>(new int(1)));
+    queue.try_emplace(new int(2));
+    std::unique_ptr<int> ele;
+    while(queue.try_pop(ele)) {
+        std::cout << "pop " << *ele << std::endl;
+    }
+
+    queue.cancel();
+    std::cout << "cancelled: " << queue.cancelled() << std::endl;
+
+    return 0;
+}
@@ -1,38 +1,94 @@
 #include "MPSCQueue.h"
+#include "MPSCNodePool.h"
 
 #include <thread>
 #include<sys/time.h>
 #include <iostream>
 #define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
 
+#define PER_PRODUCER 1000000
+
+#define BATCH 64
 
 struct Count {
     Count(int _v) : v(_v){}
     int v;
+    std::atomic<Count*> next; // 侵入式队列使用的链接
 };
 
-int main() {
+// 两个生产者各入队 PER_PRODUCER 条，一个消费者取完全部消息，返回耗时(ms)
+template<typename Queue>
+int run(Queue& queue) {
     struct timeval tv_begin;
 	gettimeofday(&tv_begin, NULL);
 
-    MPSCQueue<Count> queue;
     std::thread pd1([&]() {
-        for(int i=0;i<1000000;i++){
+        for(int i=0;i<PER_PRODUCER;i++){
             queue.Enqueue(new Count(i));
         }
     });
 
     std::thread pd2([&]() {
-        for(int i=0;i<1000000;i++){
+        for(int i=0;i<PER_PRODUCER;i++){
             queue.Enqueue(new Count(i));
         }
     });
 
     std::thread cs1([&]() {
         Count* ele;
-        while(queue.Dequeue(ele)) {
+        int received = 0;
+        while(received < 2 * PER_PRODUCER) {
+            if(!queue.Dequeue(ele)){
+                std::this_thread::yield();
+                continue;
+            }
             //std::cout << std::this_thread::get_id() << " : pop " << ele->v << std::endl;
             delete ele;
+            received++;
+        }
+    });
+
+    pd1.join();
+    pd2.join();
+    cs1.join();
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+// 同样的负载，生产者每次 EnqueueBulk 一批 BATCH 条，消费者每次 DequeueBulk 最多 BATCH 条
+template<typename Queue>
+int run_bulk(Queue& queue) {
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    auto produce = [&]() {
+        Count* batch[BATCH];
+        for(int i=0;i<PER_PRODUCER;i+=BATCH){
+            for(int j=0;j<BATCH;j++){
+                batch[j] = new Count(i + j);
+            }
+            queue.EnqueueBulk(batch, batch + BATCH);
+        }
+    };
+    std::thread pd1(produce);
+    std::thread pd2(produce);
+
+    std::thread cs1([&]() {
+        Count* batch[BATCH];
+        int received = 0;
+        while(received < 2 * PER_PRODUCER) {
+            size_t n = queue.DequeueBulk(batch, BATCH);
+            if(n == 0){
+                std::this_thread::yield();
+                continue;
+            }
+            for(size_t j=0;j<n;j++){
+                delete batch[j];
+            }
+            received += n;
         }
     });
 
@@ -43,8 +99,53 @@ int main() {
     struct timeval tv_end;
 	gettimeofday(&tv_end, NULL);
 
-	int time_used = TIME_SUB_MS(tv_end, tv_begin);
-    std::cout<<time_used<<std::endl;
-    
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main() {
+    {
+        MPSCQueue<Count> queue;
+        std::cout << "malloc: " << run(queue) << std::endl;
+    }
+
+    {
+        MPSCQueueNonIntrusive<Count, MPSCNodePool> queue;
+        int time_used = run(queue);
+        auto& pool = queue.GetNodeAllocator();
+        std::cout << "pooled: " << time_used
+                  << " (hits " << pool.Hits() << ", misses " << pool.Misses() << ")" << std::endl;
+    }
+
+    {
+        // 最多保留 4096 个空闲节点
+        MPSCQueueNonIntrusive<Count, MPSCNodePool> queue;
+        auto& pool = queue.GetNodeAllocator();
+        pool.SetMaxPooled(4096);
+        int time_used = run(queue);
+        std::cout << "pooled(max 4096): " << time_used
+                  << " (hits " << pool.Hits() << ", misses " << pool.Misses()
+                  << ", releases " << pool.Releases() << ")" << std::endl;
+    }
+
+    {
+        MPSCQueue<Count> queue;
+        std::cout << "malloc bulk(" << BATCH << "): " << run_bulk(queue) << std::endl;
+    }
+
+    {
+        MPSCQueueNonIntrusive<Count, MPSCNodePool> queue;
+        std::cout << "pooled bulk(" << BATCH << "): " << run_bulk(queue) << std::endl;
+    }
+
+    {
+        MPSCQueue<Count, &Count::next> queue;
+        std::cout << "intrusive: " << run(queue) << std::endl;
+    }
+
+    {
+        MPSCQueue<Count, &Count::next> queue;
+        std::cout << "intrusive bulk(" << BATCH << "): " << run_bulk(queue) << std::endl;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
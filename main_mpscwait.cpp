@@ -0,0 +1,82 @@
+#include "MPSCQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <sys/resource.h>
+
+// 生产者每隔 1ms 发一条消息，比较轮询消费者和阻塞消费者的唤醒延迟与 CPU 占用
+#define MSG_COUNT 1000
+
+typedef std::chrono::steady_clock Clock;
+
+struct Count {
+    Count(int _v) : v(_v), stamp(Clock::now()) {}
+    int v;
+    Clock::time_point stamp;
+};
+
+// 当前线程消耗的 CPU 时间(ms)
+static long thread_cpu_ms() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+template<typename Consume>
+static void run(const char *name, Consume consume) {
+    MPSCQueue<Count> queue;
+    std::vector<long long> latency;
+    long cpu_used = 0;
+
+    std::thread cs([&]() {
+        long cpu_begin = thread_cpu_ms();
+        for(int i=0;i<MSG_COUNT;i++){
+            Count *ele = consume(queue);
+            latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - ele->stamp).count());
+            delete ele;
+        }
+        cpu_used = thread_cpu_ms() - cpu_begin;
+    });
+
+    std::thread pd([&]() {
+        for(int i=0;i<MSG_COUNT;i++){
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            queue.Enqueue(new Count(i));
+        }
+    });
+
+    pd.join();
+    cs.join();
+
+    std::sort(latency.begin(), latency.end());
+    std::cout << name << ": consumer cpu " << cpu_used << " ms"
+              << ", p50 " << latency[latency.size() / 2] << " ns"
+              << ", p99 " << latency[latency.size() * 99 / 100] << " ns" << std::endl;
+}
+
+int main() {
+    run("poll", [](MPSCQueue<Count>& queue) {
+        Count *ele;
+        while(!queue.Dequeue(ele))
+            std::this_thread::yield();
+        return ele;
+    });
+
+    run("wait", [](MPSCQueue<Count>& queue) {
+        Count *ele;
+        queue.DequeueWait(ele);
+        return ele;
+    });
+
+    MPSCQueue<Count> queue;
+    Count *ele;
+    Clock::time_point begin = Clock::now();
+    bool got = queue.DequeueWaitFor(ele, std::chrono::milliseconds(20));
+    std::cout << "wait for empty queue: " << (got ? "got" : "timeout") << " after "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begin).count() << " ms" << std::endl;
+
+    return 0;
+}
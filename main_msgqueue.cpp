@@ -14,12 +14,13 @@ struct Count {
     Count *next;
 };
 
-int main() {
+//flags 为 msgqueue_create_ex 的创建标志，返回耗时(ms)
+static int run(int flags) {
     struct timeval tv_begin;
 	gettimeofday(&tv_begin, NULL);
 
 // linkoff  Count 偏移多少个字节就是用于链接下一个节点的next指针
-    msgqueue_t* queue = msgqueue_create(1024, sizeof(int));
+    msgqueue_t* queue = msgqueue_create_ex(1024, sizeof(int), 1, flags);
 
     msgqueue_set_nonblock(queue);  //设置为非阻塞
 
@@ -62,8 +63,12 @@ int main() {
     struct timeval tv_end;
 	gettimeofday(&tv_end, NULL);
 
-	int time_used = TIME_SUB_MS(tv_end, tv_begin);
-    std::cout<<time_used<<std::endl;
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main() {
+    std::cout<<"mutex "<<run(0)<<std::endl;
+    std::cout<<"adaptive mutex "<<run(MSGQUEUE_LOCK_ADAPTIVE)<<std::endl;
     
     return 0;
 }
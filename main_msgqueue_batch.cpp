@@ -0,0 +1,93 @@
+#include "msgqueue.h"
+
+#include <cstddef>
+#include <thread>
+
+#include<sys/time.h>
+#include <iostream>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+// 两个生产者一个消费者，比较逐条 get 和批量 get_batch/get_all 的耗时
+#define PER_PRODUCER 100000
+#define BATCH 64
+
+struct Count {
+    Count(int _v) : v(_v), next(nullptr) {}
+    int v;
+    Count *next;
+};
+
+enum Mode { GET, GET_BATCH, GET_ALL };
+
+int run(Mode mode, bool put_batch) {
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    msgqueue_t* queue = msgqueue_create(1024, offsetof(Count, next));
+
+    auto produce = [&]() {
+        if(!put_batch){
+            for(int i=0;i<PER_PRODUCER;i++){
+                msgqueue_put(new Count(i), queue);
+            }
+            return;
+        }
+
+        // 先在本地串成链，再整链入队
+        for(int i=0;i<PER_PRODUCER;i+=BATCH){
+            Count *first = nullptr;
+            for(int j=BATCH-1;j>=0;j--){
+                Count *cnt = new Count(i + j);
+                cnt->next = first;
+                first = cnt;
+            }
+            msgqueue_put_batch(first, queue);
+        }
+    };
+    std::thread pd1(produce);
+    std::thread pd2(produce);
+
+    std::thread cs1([&]() {
+        Count *batch[BATCH];
+        int received = 0;
+        while(received < 2 * PER_PRODUCER) {
+            if(mode == GET){
+                delete (Count *)msgqueue_get(queue);
+                received++;
+            }else if(mode == GET_BATCH){
+                size_t n = msgqueue_get_batch(queue, (void **)batch, BATCH);
+                for(size_t j=0;j<n;j++){
+                    delete batch[j];
+                }
+                received += n;
+            }else{
+                Count *cnt = (Count *)msgqueue_get_all(queue);
+                while(cnt){
+                    Count *next = cnt->next;
+                    delete cnt;
+                    cnt = next;
+                    received++;
+                }
+            }
+        }
+    });
+
+    pd1.join();
+    pd2.join();
+    cs1.join();
+
+    msgqueue_destroy(queue);
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main() {
+    std::cout << "get: " << run(GET, false) << std::endl;
+    std::cout << "get_batch: " << run(GET_BATCH, false) << std::endl;
+    std::cout << "get_all: " << run(GET_ALL, false) << std::endl;
+    std::cout << "put_batch + get_all: " << run(GET_ALL, true) << std::endl;
+    return 0;
+}
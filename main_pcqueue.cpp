@@ -0,0 +1,119 @@
+#include "ProducerConsumerQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// ProducerConsumerQueue 改动前后对比：
+//   旧写法：每次 Push 都在锁内 notify_one；
+//   新写法：只有消费者在等待时才通知，并且在解锁之后通知；
+//   PopAll：消费者一次换出整个容器，在锁外处理。
+// 每组都校验收到的元素个数和总和。
+#define PRODUCERS 4
+#define PER_PRODUCER 250000
+
+typedef std::chrono::steady_clock Clock;
+
+// 改动前的实现，只保留用到的部分
+template <typename T>
+class OldProducerConsumerQueue {
+public:
+    void Push(T value) {
+        std::lock_guard<std::mutex> lock(_queueLock);
+        _queue.push(std::move(value));
+        _condition.notify_one();
+    }
+
+    void WaitAndPop(T& value) {
+        std::unique_lock<std::mutex> lock(_queueLock);
+        while (_queue.empty())
+            _condition.wait(lock);
+        value = std::move(_queue.front());
+        _queue.pop();
+    }
+
+private:
+    std::mutex _queueLock;
+    std::queue<T> _queue;
+    std::condition_variable _condition;
+};
+
+// PRODUCERS 个生产者一个消费者，consume 返回这次取到的个数并累加总和
+template<typename Push, typename Consume>
+void run(const char *name, Push push, Consume consume) {
+    Clock::time_point begin = Clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&]() {
+            for (int i = 1; i <= PER_PRODUCER; i++)
+                push(i);
+        });
+    }
+
+    uint64_t sum = 0;
+    for (long long count = 0; count < (long long)PRODUCERS * PER_PRODUCER;)
+        count += consume(sum);
+
+    for (std::thread& t : producers)
+        t.join();
+
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begin).count();
+    uint64_t expect = (uint64_t)PRODUCERS * PER_PRODUCER * (PER_PRODUCER + 1) / 2;
+    std::cout << name << ": " << ms << " ms" << (sum == expect ? "" : " (sum mismatch)") << std::endl;
+}
+
+int main() {
+    {
+        OldProducerConsumerQueue<int> queue;
+        run("old Push/WaitAndPop", [&](int v) { queue.Push(v); },
+            [&](uint64_t& sum) { int v = 0; queue.WaitAndPop(v); sum += v; return 1; });
+    }
+    {
+        ProducerConsumerQueue<int> queue;
+        run("new Push/WaitAndPop", [&](int v) { queue.Push(v); },
+            [&](uint64_t& sum) { int v = 0; queue.WaitAndPop(v); sum += v; return 1; });
+    }
+    {
+        ProducerConsumerQueue<int> queue;
+        std::queue<int> batch;
+        run("new Push/WaitAndPopAll", [&](int v) { queue.Push(v); },
+            [&](uint64_t& sum) {
+                size_t n = queue.WaitAndPopAll(batch);
+                for (; !batch.empty(); batch.pop())
+                    sum += batch.front();
+                return (int)n;
+            });
+    }
+
+    // 行为检查
+    ProducerConsumerQueue<int *> queue;
+    std::queue<int *> batch;
+    std::cout << "PopAll on empty queue: " << queue.PopAll(batch) << std::endl;
+    for (int i = 0; i < 3; i++)
+        queue.Push(new int(i));
+    std::cout << "Size after 3 pushes: " << queue.Size() << std::endl;
+    std::cout << "PopAll: " << queue.PopAll(batch) << ", Size: " << queue.Size() << std::endl;
+    for (; !batch.empty(); batch.pop())
+        delete batch.front();
+
+    std::thread waiter([&]() {
+        std::queue<int *> out;
+        std::cout << "WaitAndPopAll woke with: " << queue.WaitAndPopAll(out) << std::endl;
+        for (; !out.empty(); out.pop())
+            delete out.front();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.Push(new int(4));
+    waiter.join();
+    queue.Push(new int(5));
+    queue.Cancel();   // 剩余的指针被 delete
+    std::queue<int *> out;
+    std::cout << "PopAll after Cancel: " << queue.PopAll(out) << ", Size: " << queue.Size() << std::endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "msgqueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// 一个生产者持续灌入大量普通消息，另一个生产者每隔一段时间发一条控制消息，
+// 比较单通道 msgqueue 和优先级 msgqueue 上控制消息的排队延迟
+#define BULK_COUNT 200000
+#define CONTROL_COUNT 200
+
+typedef std::chrono::steady_clock Clock;
+
+struct Msg {
+    Msg(int _prio) : prio(_prio), stamp(Clock::now()), next(nullptr) {}
+    int prio;
+    Clock::time_point stamp;
+    Msg *next;
+};
+
+static void run(const char *name, msgqueue_t *queue) {
+    std::vector<long long> latency;
+
+    std::thread bulk([&]() {
+        for(int i=0;i<BULK_COUNT;i++){
+            msgqueue_put(new Msg(1), queue);
+        }
+    });
+    std::thread control([&]() {
+        for(int i=0;i<CONTROL_COUNT;i++){
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            msgqueue_put_prio(new Msg(0), 0, queue);
+        }
+    });
+    std::thread cs([&]() {
+        for(int i=0;i<BULK_COUNT + CONTROL_COUNT;i++){
+            Msg *msg = (Msg *)msgqueue_get(queue);
+            if(msg->prio == 0)
+                latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - msg->stamp).count());
+            // 模拟处理普通消息的开销
+            for(volatile int j=0;j<100;j++)
+                ;
+            delete msg;
+        }
+    });
+
+    bulk.join();
+    control.join();
+    cs.join();
+
+    std::sort(latency.begin(), latency.end());
+    std::cout << name << ": control p50 " << latency[latency.size() / 2] << " ns"
+              << ", p99 " << latency[latency.size() * 99 / 100] << " ns" << std::endl;
+}
+
+int main() {
+    msgqueue_t *fifo = msgqueue_create(4096, offsetof(Msg, next));
+    run("fifo", fifo);
+    msgqueue_destroy(fifo);
+
+    msgqueue_t *prio = msgqueue_create_prio(4096, offsetof(Msg, next), 2);
+    run("prio", prio);
+    msgqueue_destroy(prio);
+
+    // 高优先级一直有消息时，开启 aging 后低优先级也能被服务
+    msgqueue_t *aging = msgqueue_create_prio(64, offsetof(Msg, next), 3);
+    msgqueue_set_nonblock(aging);
+    msgqueue_set_aging(aging, 3);
+    for(int i=0;i<6;i++){
+        msgqueue_put_prio(new Msg(0), 0, aging);
+    }
+    msgqueue_put_prio(new Msg(2), 2, aging);
+    msgqueue_put_prio(new Msg(1), 1, aging);
+    std::cout << "aging order:";
+    Msg *msg;
+    while((msg = (Msg *)msgqueue_get(aging)) != NULL) {
+        std::cout << " " << msg->prio;
+        delete msg;
+    }
+    std::cout << std::endl;
+    msgqueue_destroy(aging);
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "LockedQueue.h"
+#include "MPSCQueue.h"
+#include "ProducerConsumerQueue.h"
+#include "msgqueue.h"
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// 编译时加上 -DMARK_QUEUE_STATS 才有数据，例如：
+// gcc -DMARK_QUEUE_STATS -c msgqueue.c && g++ -std=c++17 -DMARK_QUEUE_STATS main_queuestats.cpp msgqueue.o -pthread
+#define PRODUCERS 4
+#define PER_PRODUCER 100000
+
+struct Count {
+    Count(int _v) : v(_v), next(nullptr) {}
+    int v;
+    Count *next;
+};
+
+static void print(const char *name, const QueueStatsSnapshot& s) {
+    std::cout << name << ": enq " << s.Enqueues << ", deq " << s.Dequeues << ", depth " << s.Depth
+              << ", high water " << s.HighWater << ", blocked " << s.BlockedWaits << ", empty polls " << s.EmptyPolls
+              << ", sojourn avg " << (s.SojournSamples ? s.SojournTotalNs / s.SojournSamples : 0) << " ns max " << s.SojournMaxNs
+              << ", lock hold avg " << (s.LockHoldSamples ? s.LockHoldTotalNs / s.LockHoldSamples : 0) << " ns max " << s.LockHoldMaxNs
+              << std::endl;
+}
+
+// 多个生产者，一个消费者持续取，直到取够 total 个
+template<typename Produce, typename Consume>
+static void run(Produce produce, Consume consume) {
+    std::vector<std::thread> threads;
+    for(int p=0;p<PRODUCERS;p++){
+        threads.emplace_back([&]() {
+            for(int i=0;i<PER_PRODUCER;i++){
+                produce(i);
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        for(int i=0;i<PRODUCERS * PER_PRODUCER;){
+            if(consume())
+                i++;
+            else
+                std::this_thread::yield();
+        }
+    });
+    for(std::thread& t : threads){
+        t.join();
+    }
+}
+
+int main() {
+    if(!QueueStats::Enabled)
+        std::cout << "built without MARK_QUEUE_STATS, all counters are zero" << std::endl;
+
+    LockedQueue<int> locked;
+    run([&](int i) { locked.add(i); }, [&]() { int v; return locked.next(v); });
+    print("LockedQueue", locked.stats());
+
+    ProducerConsumerQueue<int> pcq;
+    run([&](int i) { pcq.Push(i); }, [&]() { int v; pcq.WaitAndPop(v); return true; });
+    print("ProducerConsumerQueue", pcq.Stats());
+
+    MPSCQueueNonIntrusive<int> mpsc;
+    int value = 0;
+    run([&](int) { mpsc.Enqueue(&value); }, [&]() { int *v; mpsc.DequeueWait(v); return true; });
+    print("MPSCQueueNonIntrusive", mpsc.Stats());
+
+    msgqueue_t *queue = msgqueue_create(1024, offsetof(Count, next));
+    run([&](int i) { msgqueue_put(new Count(i), queue); }, [&]() { delete (Count *)msgqueue_get(queue); return true; });
+    struct msgqueue_stats s;
+    if(msgqueue_get_stats(queue, &s) == 0) {
+        std::cout << "msgqueue: puts " << s.puts << ", gets " << s.gets << ", high water " << s.high_water
+                  << ", blocked puts " << s.blocked_puts << ", blocked gets " << s.blocked_gets
+                  << ", empty swaps " << s.empty_swaps
+                  << ", sojourn avg " << (s.sojourn_samples ? s.sojourn_total_ns / s.sojourn_samples : 0)
+                  << " ns max " << s.sojourn_max_ns << std::endl;
+    }
+    msgqueue_destroy(queue);
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "MPSCQueue.h"
+#include "SegmentedMPSCQueue.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+#include<sys/time.h>
+#include <iostream>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+// 链表 MPSC 队列和分段数组 MPSC 队列的对比：耗时和堆分配次数
+#define PRODUCERS 4
+#define PER_PRODUCER 500000
+
+// 统计全局 new 的次数
+static std::atomic<long> allocations(0);
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+struct Msg {
+    int producer;
+    int seq;
+};
+
+// 返回耗时(ms)，同时检查每个生产者的消息按顺序到达
+template<typename Enqueue, typename Dequeue>
+static int run(Enqueue enqueue, Dequeue dequeue) {
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    std::vector<std::thread> threads;
+    for(int p=0;p<PRODUCERS;p++){
+        threads.emplace_back([&, p]() {
+            for(int i=0;i<PER_PRODUCER;i++){
+                enqueue(Msg{p, i});
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        int expect[PRODUCERS] = {0};
+        Msg msg;
+        for(int i=0;i<PRODUCERS * PER_PRODUCER;){
+            if(!dequeue(msg)){
+                std::this_thread::yield();
+                continue;
+            }
+            if(msg.seq != expect[msg.producer]++)
+                std::cout << "out of order" << std::endl;
+            i++;
+        }
+    });
+    for(std::thread& t : threads){
+        t.join();
+    }
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main() {
+    {
+        MPSCQueueNonIntrusive<Msg> queue;
+        long before = allocations.load();
+        int ms = run([&](const Msg& msg) { queue.Enqueue(new Msg(msg)); },
+                     [&](Msg& msg) { Msg *p; if(!queue.Dequeue(p)) return false; msg = *p; delete p; return true; });
+        std::cout << "MPSCQueueNonIntrusive: " << ms << " ms, " << allocations.load() - before << " allocations" << std::endl;
+    }
+
+    {
+        SegmentedMPSCQueue<Msg> queue;
+        long before = allocations.load();
+        int ms = run([&](const Msg& msg) { queue.Enqueue(msg); }, [&](Msg& msg) { return queue.Dequeue(msg); });
+        std::cout << "SegmentedMPSCQueue: " << ms << " ms, " << allocations.load() - before << " allocations" << std::endl;
+    }
+
+    // 阻塞出队
+    SegmentedMPSCQueue<int, 16> small;
+    std::thread pd([&]() {
+        for(int i=0;i<100;i++){
+            small.Enqueue(i);
+        }
+    });
+    int sum = 0;
+    for(int i=0;i<100;i++){
+        int v;
+        small.DequeueWait(v);
+        sum += v;
+    }
+    pd.join();
+    std::cout << "DequeueWait sum " << sum << std::endl;
+
+    return 0;
+}
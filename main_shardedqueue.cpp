@@ -0,0 +1,81 @@
+#include "ShardedQueue.h"
+#include "LockedQueue.h"
+#include "MPMCQueue.h"
+
+#include <thread>
+#include <vector>
+#include<sys/time.h>
+#include <iostream>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+// 生产者数从 1 增加到核数，比较单锁 LockedQueue 和分片队列的入队耗时
+#define PER_PRODUCER 500000
+
+// 返回所有生产者入队完成的耗时(ms)，之后由两个消费者取空
+template<typename Queue>
+int run(Queue& queue, int producers) {
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    std::vector<std::thread> threads;
+    for(int p=0;p<producers;p++){
+        threads.emplace_back([&]() {
+            for(int i=0;i<PER_PRODUCER;i++){
+                queue.add(i);
+            }
+        });
+    }
+    for(std::thread& t : threads){
+        t.join();
+    }
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+
+    threads.clear();
+    for(int c=0;c<2;c++){
+        threads.emplace_back([&]() {
+            int ele;
+            while(queue.next(ele))
+                ;
+        });
+    }
+    for(std::thread& t : threads){
+        t.join();
+    }
+
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main() {
+    int cores = std::thread::hardware_concurrency();
+    if(cores < 2)
+        cores = 2;
+
+    for(int producers=1;producers<=cores;producers*=2){
+        LockedQueue<int> locked;
+        ShardedQueue<int> sharded(cores);
+        ShardedQueue<int> stealing(cores, ShardedQueue<int>::WorkStealing);
+        std::cout << producers << " producers: LockedQueue " << run(locked, producers)
+                  << ", ShardedQueue " << run(sharded, producers)
+                  << ", ShardedQueue(work stealing) " << run(stealing, producers) << std::endl;
+    }
+
+    // 无锁通道
+    ShardedQueue<int, MPMCQueue<int>> lockfree(cores, ShardedQueue<int, MPMCQueue<int>>::RoundRobin, 1 << 20);
+    std::cout << cores << " producers: ShardedQueue<MPMCQueue> " << run(lockfree, cores) << std::endl;
+
+    // 同一 key 的消息按入队顺序出队
+    ShardedQueue<int> keyed(4);
+    for(int i=0;i<8;i++){
+        keyed.add(i % 2, i);
+    }
+    int ele;
+    std::cout << "keyed pop:";
+    while(keyed.next(ele)) {
+        std::cout << " " << ele;
+    }
+    std::cout << std::endl;
+
+    return 0;
+}
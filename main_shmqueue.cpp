@@ -0,0 +1,118 @@
+#include "ShmMPSCQueue.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include<sys/time.h>
+#include <iostream>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+// 用法：
+//   main_shmqueue                      创建队列，fork 出 PRODUCERS 个生产者进程，本进程作为消费者
+//   main_shmqueue consumer /name       在两个终端里分别运行，消费者创建队列
+//   main_shmqueue producer /name       生产者打开队列并发送 PER_PRODUCER 条消息
+#define PRODUCERS 2
+#define PER_PRODUCER 100000
+#define SLOT_COUNT 4096
+
+struct Msg {
+    int producer;
+    int seq;
+    char text[48];
+};
+
+static int produce(const char *name, int producer) {
+    std::unique_ptr<ShmMPSCQueue> queue;
+    // 消费者可能还没创建好队列
+    for(int i=0;i<100 && !(queue = ShmMPSCQueue::Open(name));i++){
+        usleep(10000);
+    }
+    if(!queue){
+        perror("ShmMPSCQueue::Open");
+        return 1;
+    }
+
+    for(int i=0;i<PER_PRODUCER;i++){
+        void *slot;
+        while((slot = queue->Allocate()) == nullptr)
+            std::this_thread::yield();   // 消息区满了，等消费者释放
+
+        // 直接在共享内存里构造消息，不经过中间缓冲
+        Msg *msg = static_cast<Msg *>(slot);
+        msg->producer = producer;
+        msg->seq = i;
+        snprintf(msg->text, sizeof(msg->text), "hello from %d", (int)getpid());
+        queue->Enqueue(slot, sizeof(Msg));
+    }
+    return 0;
+}
+
+static int consume(ShmMPSCQueue& queue, int producers) {
+    std::vector<int> expect(producers, 0);
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    for(int received=0;received<producers * PER_PRODUCER;received++){
+        const void *payload;
+        uint32_t length;
+        queue.DequeueWait(payload, length);
+        const Msg *msg = static_cast<const Msg *>(payload);
+        if(length != sizeof(Msg) || msg->producer < 0 || msg->producer >= producers || msg->seq != expect[msg->producer]++){
+            std::cout << "out of order message from producer " << msg->producer << std::endl;
+            return 1;
+        }
+    }
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+    std::cout << producers * PER_PRODUCER << " messages from " << producers << " processes in "
+              << TIME_SUB_MS(tv_end, tv_begin) << " ms" << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc == 3 && strcmp(argv[1], "producer") == 0)
+        return produce(argv[2], 0);
+
+    if(argc == 3 && strcmp(argv[1], "consumer") == 0) {
+        std::unique_ptr<ShmMPSCQueue> queue = ShmMPSCQueue::Create(argv[2], sizeof(Msg), SLOT_COUNT);
+        if(!queue){
+            perror("ShmMPSCQueue::Create");
+            return 1;
+        }
+        int ret = consume(*queue, 1);
+        ShmMPSCQueue::Unlink(argv[2]);
+        return ret;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/mark_shmqueue_%d", (int)getpid());
+    std::unique_ptr<ShmMPSCQueue> queue = ShmMPSCQueue::Create(name, sizeof(Msg), SLOT_COUNT);
+    if(!queue){
+        perror("ShmMPSCQueue::Create");
+        return 1;
+    }
+
+    std::vector<pid_t> children;
+    for(int p=0;p<PRODUCERS;p++){
+        pid_t pid = fork();
+        if(pid == 0)
+            _exit(produce(name, p));
+        children.push_back(pid);
+    }
+
+    int ret = consume(*queue, PRODUCERS);
+    for(pid_t pid : children){
+        int status;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ret = 1;
+    }
+
+    ShmMPSCQueue::Unlink(name);
+    return ret;
+}
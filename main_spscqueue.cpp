@@ -0,0 +1,152 @@
+#include "SPSCQueue.h"
+#include "MPSCQueue.h"
+#include "LockedQueue.h"
+#include "msgqueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// 一个生产者、一个消费者，比较各队列的吞吐和入队到出队的延迟
+#define MSG_COUNT 1000000
+
+typedef std::chrono::steady_clock Clock;
+
+struct Count {
+    Count() : v(0), next(nullptr) {}
+    Count(int _v) : v(_v), stamp(Clock::now()), next(nullptr) {}
+    int v;
+    Clock::time_point stamp;
+    Count *next;
+};
+
+static void report(const char *name, Clock::time_point begin, std::vector<long long>& latency) {
+    long long time_used = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begin).count();
+    std::sort(latency.begin(), latency.end());
+    std::cout << name << ": " << time_used << " ms"
+              << ", p50 " << latency[latency.size() / 2] << " ns"
+              << ", p99 " << latency[latency.size() * 99 / 100] << " ns" << std::endl;
+}
+
+static long long since(const Count& c) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - c.stamp).count();
+}
+
+static void bench_spsc() {
+    SPSCQueue<Count> queue(1024);
+    std::vector<long long> latency;
+    latency.reserve(MSG_COUNT);
+    Clock::time_point begin = Clock::now();
+
+    std::thread pd([&]() {
+        for(int i=0;i<MSG_COUNT;i++){
+            while(!queue.Enqueue(Count(i)))
+                std::this_thread::yield();
+        }
+    });
+    std::thread cs([&]() {
+        Count ele;
+        for(int i=0;i<MSG_COUNT;){
+            if(queue.Dequeue(ele)){
+                latency.push_back(since(ele));
+                i++;
+            }else{
+                std::this_thread::yield();
+            }
+        }
+    });
+    pd.join();
+    cs.join();
+    report("SPSCQueue", begin, latency);
+}
+
+static void bench_mpsc() {
+    MPSCQueue<Count> queue;
+    std::vector<long long> latency;
+    latency.reserve(MSG_COUNT);
+    Clock::time_point begin = Clock::now();
+
+    std::thread pd([&]() {
+        for(int i=0;i<MSG_COUNT;i++){
+            queue.Enqueue(new Count(i));
+        }
+    });
+    std::thread cs([&]() {
+        Count *ele;
+        for(int i=0;i<MSG_COUNT;){
+            if(queue.Dequeue(ele)){
+                latency.push_back(since(*ele));
+                delete ele;
+                i++;
+            }else{
+                std::this_thread::yield();
+            }
+        }
+    });
+    pd.join();
+    cs.join();
+    report("MPSCQueue", begin, latency);
+}
+
+static void bench_locked() {
+    LockedQueue<Count> queue;
+    std::vector<long long> latency;
+    latency.reserve(MSG_COUNT);
+    Clock::time_point begin = Clock::now();
+
+    std::thread pd([&]() {
+        for(int i=0;i<MSG_COUNT;i++){
+            queue.add(Count(i));
+        }
+    });
+    std::thread cs([&]() {
+        Count ele;
+        for(int i=0;i<MSG_COUNT;){
+            if(queue.next(ele)){
+                latency.push_back(since(ele));
+                i++;
+            }else{
+                std::this_thread::yield();
+            }
+        }
+    });
+    pd.join();
+    cs.join();
+    report("LockedQueue", begin, latency);
+}
+
+static void bench_msgqueue() {
+    msgqueue_t* queue = msgqueue_create(1024, offsetof(Count, next));
+    std::vector<long long> latency;
+    latency.reserve(MSG_COUNT);
+    Clock::time_point begin = Clock::now();
+
+    std::thread pd([&]() {
+        for(int i=0;i<MSG_COUNT;i++){
+            msgqueue_put(new Count(i), queue);
+        }
+    });
+    std::thread cs([&]() {
+        Count *ele;
+        for(int i=0;i<MSG_COUNT;i++){
+            ele = (Count *)msgqueue_get(queue);
+            latency.push_back(since(*ele));
+            delete ele;
+        }
+    });
+    pd.join();
+    cs.join();
+    msgqueue_destroy(queue);
+    report("msgqueue", begin, latency);
+}
+
+int main() {
+    bench_spsc();
+    bench_mpsc();
+    bench_locked();
+    bench_msgqueue();
+    return 0;
+}
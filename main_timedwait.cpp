@@ -0,0 +1,75 @@
+#include "msgqueue.h"
+#include "ProducerConsumerQueue.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <iostream>
+
+// 工作线程用带超时的等待代替轮询：没有消息时定期醒来做自己的事情
+
+typedef std::chrono::steady_clock Clock;
+
+struct Count {
+    Count(int _v) : v(_v), next(nullptr) {}
+    int v;
+    Count *next;
+};
+
+static long long elapsed_ms(Clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begin).count();
+}
+
+int main() {
+    msgqueue_t* queue = msgqueue_create(2, offsetof(Count, next));
+
+    // 空队列上等待 50ms
+    Clock::time_point begin = Clock::now();
+    void *msg = msgqueue_get_timed(queue, 50 * 1000000LL);
+    std::cout << "get_timed on empty queue: " << (msg ? "got" : "timeout") << " after " << elapsed_ms(begin) << " ms" << std::endl;
+
+    // 填满队列后 put 超时
+    Count *cnt = new Count(0);
+    msgqueue_put(new Count(1), queue);
+    msgqueue_put(new Count(2), queue);
+    begin = Clock::now();
+    int ret = msgqueue_put_timed(cnt, 50 * 1000000LL, queue);
+    std::cout << "put_timed on full queue: " << (ret == 0 ? "ok" : (errno == ETIMEDOUT ? "timeout" : "error"))
+              << " after " << elapsed_ms(begin) << " ms" << std::endl;
+    delete cnt;
+
+    // 工作线程每 10ms 醒来一次，直到收到消息
+    std::thread worker([&]() {
+        int wakeups = 0;
+        Count *c;
+        while ((c = (Count *)msgqueue_get_timed(queue, 10 * 1000000LL)) == NULL || c->v != 3) {
+            if (c)
+                delete c;
+            else
+                wakeups++;
+        }
+        std::cout << "worker got 3 after " << wakeups << " housekeeping wakeups" << std::endl;
+        delete c;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(55));
+    msgqueue_put(new Count(3), queue);
+    worker.join();
+    msgqueue_destroy(queue);
+
+    ProducerConsumerQueue<int> pcq;
+    int value;
+    begin = Clock::now();
+    bool got = pcq.WaitAndPopFor(value, std::chrono::milliseconds(50));
+    std::cout << "WaitAndPopFor on empty queue: " << (got ? "got" : "timeout") << " after " << elapsed_ms(begin) << " ms" << std::endl;
+
+    std::thread pd([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        pcq.Push(42);
+    });
+    got = pcq.WaitAndPopUntil(value, Clock::now() + std::chrono::seconds(1));
+    std::cout << "WaitAndPopUntil: " << (got ? "got " : "timeout ") << value << std::endl;
+    pd.join();
+
+    return 0;
+}
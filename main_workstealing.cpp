@@ -0,0 +1,222 @@
+#include "LockedQueue.h"
+#include "WorkStealingPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include<sys/time.h>
+#include <iostream>
+#define TIME_SUB_MS(tv1, tv2)  ((tv1.tv_sec - tv2.tv_sec) * 1000 + (tv1.tv_usec - tv2.tv_usec) / 1000)
+
+// 工作窃取线程池和"所有线程共享一个 LockedQueue"的任务池对比：
+//   小任务：外部线程提交大量很小的任务；
+//   fork/join：递归计算 fib，每层派生两个子任务再等待。
+// 另外检查线程池空闲（所有工作线程都睡了）之后外部单独提交的任务不会被漏掉，
+// 以及一个线程忙于长任务时，外部提交的短任务不会排在它后面。
+#define SMALL_TASKS 1000000
+#define FIB_N 24
+#define FIB_CUTOFF 8
+#define IDLE_PROBES 40
+#define LONG_TASK_MS 200
+
+// 现在的用法：一个 LockedQueue 作为共享任务池，工作线程轮询取任务
+class LockedQueuePool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit LockedQueuePool(size_t threads) : _stop(false) {
+        for(size_t i=0;i<threads;i++){
+            _threads.emplace_back([this]() {
+                while(!_stop.load(std::memory_order_relaxed)) {
+                    if(!RunPendingTask())
+                        std::this_thread::yield();
+                }
+            });
+        }
+    }
+
+    ~LockedQueuePool() {
+        _stop = true;
+        for(std::thread& t : _threads){
+            t.join();
+        }
+    }
+
+    void Submit(Task task) { _tasks.add(std::move(task)); }
+
+    bool RunPendingTask() {
+        Task task;
+        if(!_tasks.next(task))
+            return false;
+        task();
+        return true;
+    }
+
+private:
+    LockedQueue<Task> _tasks;
+    std::atomic<bool> _stop;
+    std::vector<std::thread> _threads;
+};
+
+// 与 TaskGroup 相同的 fork/join，等待时帮忙执行任务
+template<typename Pool>
+class Group {
+public:
+    explicit Group(Pool& pool) : _pool(pool), _pending(0) {}
+
+    template<typename Function>
+    void Run(Function function) {
+        _pending.fetch_add(1, std::memory_order_relaxed);
+        _pool.Submit([this, function]() {
+            function();
+            _pending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    void Wait() {
+        while(_pending.load(std::memory_order_acquire)) {
+            if(!_pool.RunPendingTask())
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    Pool& _pool;
+    std::atomic<size_t> _pending;
+};
+
+static long fib_serial(int n) {
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+template<typename Pool>
+static long fib(Pool& pool, int n) {
+    if(n < FIB_CUTOFF)
+        return fib_serial(n);
+
+    long a = 0, b = 0;
+    Group<Pool> group(pool);
+    group.Run([&]() { a = fib(pool, n - 1); });
+    group.Run([&]() { b = fib(pool, n - 2); });
+    group.Wait();
+    return a + b;
+}
+
+// 返回耗时(ms)
+template<typename Pool>
+static int small_tasks(Pool& pool) {
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    std::atomic<long> done(0);
+    for(int i=0;i<SMALL_TASKS;i++){
+        pool.Submit([&]() { done.fetch_add(1, std::memory_order_relaxed); });
+    }
+    while(done.load() < SMALL_TASKS) {
+        if(!pool.RunPendingTask())
+            std::this_thread::yield();
+    }
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+template<typename Pool>
+static int fork_join(Pool& pool, long& result) {
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    result = fib(pool, FIB_N);
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+// 随机的一小波任务之后等线程池睡下，再从外部提交一个任务，1 秒内没有执行的算漏掉。返回漏掉的次数
+static int idle_submit(size_t threads) {
+    WorkStealingPool pool(threads);
+    int lost = 0;
+    for(int probe=0;probe<IDLE_PROBES;probe++){
+        int count = rand() % 16;
+        for(int i=0;i<count;i++){
+            pool.Submit([]() {});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        // 漏掉的任务可能在这一轮之后才执行，甚至随线程池析构被丢弃，标志放在堆上由任务共同持有
+        std::shared_ptr<std::atomic<bool>> done(new std::atomic<bool>(false));
+        pool.Submit([done]() { *done = true; });
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while(!done->load() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        if(!done->load())
+            lost++;
+    }
+    return lost;
+}
+
+// 一个工作线程执行长任务、其余都睡下之后，外部逐个提交 threads 个短任务，返回全部执行完的耗时(ms)
+static int behind_long_task(size_t threads) {
+    WorkStealingPool pool(threads);
+    pool.Submit([]() { std::this_thread::sleep_for(std::chrono::milliseconds(LONG_TASK_MS)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    struct timeval tv_begin;
+	gettimeofday(&tv_begin, NULL);
+
+    std::shared_ptr<std::atomic<size_t>> done(new std::atomic<size_t>(0));
+    for(size_t i=0;i<threads;i++){
+        pool.Submit([done]() { done->fetch_add(1); });
+    }
+    while(done->load() < threads)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+    struct timeval tv_end;
+	gettimeofday(&tv_end, NULL);
+	return TIME_SUB_MS(tv_end, tv_begin);
+}
+
+int main() {
+    size_t threads = std::thread::hardware_concurrency();
+    if(threads < 2)
+        threads = 2;
+
+    long locked_fib, stealing_fib;
+    {
+        LockedQueuePool pool(threads);
+        int small = small_tasks(pool);
+        int fj = fork_join(pool, locked_fib);
+        std::cout << "LockedQueue pool: small tasks " << small << " ms, fork/join " << fj << " ms" << std::endl;
+    }
+    {
+        WorkStealingPool pool(threads);
+        int small = small_tasks(pool);
+        int fj = fork_join(pool, stealing_fib);
+        std::cout << "WorkStealingPool: small tasks " << small << " ms, fork/join " << fj << " ms" << std::endl;
+    }
+
+    if(locked_fib != stealing_fib || locked_fib != fib_serial(FIB_N))
+        std::cout << "wrong result" << std::endl;
+
+    // TaskGroup 的用法
+    WorkStealingPool pool(threads);
+    std::atomic<int> sum(0);
+    {
+        TaskGroup group(pool);
+        for(int i=1;i<=100;i++){
+            group.Run([&sum, i]() { sum += i; });
+        }
+    }
+    std::cout << "TaskGroup sum " << sum.load() << std::endl;
+
+    std::cout << "submit after idle: " << idle_submit(threads < 4 ? 4 : threads) << " of " << IDLE_PROBES << " lost" << std::endl;
+    std::cout << "short tasks beside a " << LONG_TASK_MS << " ms task: " << behind_long_task(threads < 4 ? 4 : threads) << " ms" << std::endl;
+
+    return 0;
+}
@@ -1,25 +1,196 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	/* PTHREAD_MUTEX_ADAPTIVE_NP */
+#endif
 #include<error.h>
+#include<errno.h>
+#include<time.h>
 #include<stdlib.h>
+#include<string.h>
 #include<pthread.h>
 #include<stdio.h>
+#include<fcntl.h>
+#include<dirent.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
 #include"msgqueue.h"
+#include"CacheLine.h"
 
 //这个代码也是有锁队列，但是为了减少生产者线程和消费者线程之间的碰撞进行优化
 
+//每个优先级一条通道，put 端和 get 端各一条链表，swap 时把 put 端整条接到 get 端后面
+//put 端链表由 put_mutex 保护，get 端链表由 get_mutex 保护，两组链表分别放在各自的缓存行区域里
+struct __msgqueue_list{
+    void *first;   //链表头
+    void **tail;   //最后一个链接的位置
+};
+
+#define __MSGQUEUE_ALIGNED	__attribute__((aligned(MARK_CACHE_LINE_SIZE)))
+
+/* Messages put with 'msgqueue_put_at' wait in a hierarchical timing wheel on
+ * the put side, under put_mutex. Level L has 64 slots of 64^L ticks each;
+ * slot s of level L holds the messages whose deadline tick t has
+ * (t >> 6L) % 64 == s and is less than 64^(L+1) ticks away. Level 0 slots
+ * hold a single tick and are spliced onto the put list whole when it comes
+ * up. When the clock enters a new block of 64^L ticks, the matching slot of
+ * level L is cascaded: each message goes down by its own deadline, kept in
+ * the message at the offset given to 'msgqueue_set_deadline_offset'.
+ * Deadlines beyond the top level are parked in its farthest slot and
+ * cascaded back up until they come into range. */
+#ifndef MSGQUEUE_WHEEL_TICK_NS
+#define MSGQUEUE_WHEEL_TICK_NS	1000000
+#endif
+#define MSGQUEUE_WHEEL_BITS		6
+#define MSGQUEUE_WHEEL_SLOTS	(1 << MSGQUEUE_WHEEL_BITS)
+#define MSGQUEUE_WHEEL_LEVELS	4
+
+struct __msgqueue_slot{
+    void *first;
+    void **tail;
+    size_t cnt;
+};
+
+struct __msgqueue_wheel{
+    unsigned long long now;     //已经处理到的时刻（tick）
+    unsigned long long wake;    //消费者定时睡眠到的时刻，没有时为 ~0
+    size_t pending;             //轮子里的消息数
+    unsigned long long bitmap[MSGQUEUE_WHEEL_LEVELS];  //每层非空槽位的位图
+    struct __msgqueue_slot slots[MSGQUEUE_WHEEL_LEVELS][MSGQUEUE_WHEEL_SLOTS];
+};
+
+/* A journal is a directory of segment files plus a file 'commit' holding
+ * the committed offset. Offsets are global: segment n covers
+ * [n * seg_size, (n + 1) * seg_size) and is the file "<n in hex>.seg".
+ * A record is a header and the message bytes, padded to 8 bytes. A record
+ * never straddles two segments: when it does not fit in what is left of
+ * one, the rest stays zero and the record starts the next segment. The put
+ * side, the get side and the recovery all step through offsets by this same
+ * rule. An all-zero header marks the end of the data in a segment. */
+#define MSGQUEUE_JOURNAL_INTERVAL_NS	10000000
+
+struct __msgqueue_record{
+    unsigned int size;    //消息字节数
+    unsigned int check;   //校验和，不会为 0
+};
+
+struct __msgqueue_segment{
+    unsigned long long index;  //段号
+    int fd;
+    char *base;                //映射地址
+    size_t synced;             //已经 msync 的字节数，只由刷盘线程修改
+    size_t end;                //封存时写到的字节数
+    struct __msgqueue_segment *next;
+};
+
+struct __msgqueue_journal{
+    //只读配置
+    int dirfd;
+    int commitfd;         //保存提交偏移的文件
+    size_t seg_size;
+    size_t page_size;
+    long long interval_ns;
+    msgqueue_msgsize_t size;
+    pthread_t flusher;
+
+    //写入端，由 put_mutex 保护；written 刷盘线程也会读，limit get 端也会读
+    struct __msgqueue_segment *active;  //正在写的段，更换时还要持有 mutex
+    unsigned long long written;  //最后一条记录之后的偏移
+    unsigned long long limit;    //写入出错时的偏移，之后的消息没有记录；没出错时为 ~0
+
+    //get 端，由 get_mutex 保护
+    unsigned long long consumed __MSGQUEUE_ALIGNED;  //已经取走的消息之后的偏移
+
+    //刷盘线程独占
+    unsigned long long persisted;  //已经写进 commit 文件的偏移
+
+    //由 mutex 保护
+    pthread_mutex_t mutex __MSGQUEUE_ALIGNED;
+    pthread_cond_t flush_cond;     //唤醒刷盘线程
+    pthread_cond_t sync_cond;      //一轮刷盘完成
+    struct __msgqueue_segment *sealed;  //写满后还没刷完的段
+    struct __msgqueue_segment *spare;   //刷盘线程预先建好的下一段，换段时直接取用
+    unsigned long long committed;  //请求提交的偏移
+    unsigned long long oldest;     //磁盘上可能还在的最早段号
+    unsigned long long rounds;     //开始的刷盘轮数
+    unsigned long long done;       //完成的刷盘轮数
+    int wanted;     //有线程在等刷盘
+    int prepare;    //备用段被取走了，刷盘线程要准备下一个
+    int dir_dirty;  //新建过段文件，目录需要 fsync
+    int error;      //第一次出错的 errno
+    int stop;
+};
+
+#ifdef MARK_QUEUE_STATS
+/* Counters are updated with relaxed atomics, almost always under the lock of
+ * their side, so puts and gets never write the same cache line and a reader
+ * needs no lock. Sojourn time follows one message at a time: the put side
+ * stamps the message with sequence number 'trace_seq', and the get side
+ * reports when its own sequence number reaches it. */
+struct __msgqueue_stats{
+    unsigned long long puts;
+    unsigned long long blocked_puts;
+    unsigned long long blocked_gets;
+    unsigned long long empty_swaps;
+    unsigned long long high_water;
+    unsigned long long trace_seq;
+    unsigned long long trace_stamp;
+    unsigned long long gets __MSGQUEUE_ALIGNED;
+    unsigned long long sojourn_samples;
+    unsigned long long sojourn_total_ns;
+    unsigned long long sojourn_max_ns;
+};
+
+#define MSGQUEUE_SAMPLE_EVERY	64
+#define __MSGQUEUE_STAT(stmt)	stmt
+#else
+#define __MSGQUEUE_STAT(stmt)
+#endif
+
+//字段按访问方分成四块，各自从新的缓存行开始：
+//创建后只读的配置；生产者每次 put 都要写的 put 端；消费者每次 get 都要写的 get 端；
+//只有开启信用或水位回调时才会写的两端共享部分。
+//生产者之间本来就要抢 put_mutex，但它们不会再和消费者抢同一条缓存行。
 struct __msgqueue{
+    //只读配置
     size_t msg_max;   //消息队列里的最大数量
-    size_t msg_cnt;   //表示当前消息队列中的消息数量
     int linkoff;      //链接偏移
-    int nonblock;     //非阻塞标志
-    void *head1;      //put
-    void *head2;      //get
-    void **get_head;  //put
-    void **put_head;  //put
-    void **put_tail;  //get
-    pthread_mutex_t get_mutex;
-    pthread_mutex_t put_mutex;
-    pthread_cond_t get_cond;
+    int nonblock;     //非阻塞标志，很少修改
+    int nlanes;       //优先级通道数，0 号通道优先级最高
+    int credit_mode;  //MSGQUEUE_CREDITS
+    int deadoff;      //截止时间偏移，msgqueue_set_deadline_offset 设置
+    int has_deadoff;  //设置过截止时间偏移才能 put_at
+    struct __msgqueue_list *put_lists;  //put 端链表，每个通道一条
+    struct __msgqueue_list *get_lists;  //get 端链表，每个通道一条
+    struct __msgqueue_journal *journal; //日志，msgqueue_open_journal 之后才有
+    msgqueue_watermark_t watermark;     //水位回调，为空时不统计 depth
+    void *watermark_ctx;
+    size_t low_mark;
+    size_t high_mark;
+
+    //put 端，由 put_mutex 保护；get_cond 由消费者在 swap 时持 put_mutex 等待
+    pthread_mutex_t put_mutex __MSGQUEUE_ALIGNED;
     pthread_cond_t put_cond;
+    pthread_cond_t get_cond;
+    size_t msg_cnt;   //表示当前 put 端的消息数量
+    unsigned put_mask;  //put 端非空通道的位图，get 端不加锁读取，只作提示
+    struct __msgqueue_wheel *wheel;  //延迟消息的时间轮，第一次 put_at 时分配
+
+    //get 端，由 get_mutex 保护
+    pthread_mutex_t get_mutex __MSGQUEUE_ALIGNED;
+    size_t aging;     //防饿死阈值，0 表示关闭
+    size_t starve;    //连续越过低优先级消息的次数
+#ifdef MARK_QUEUE_STATS
+    struct __msgqueue_stats stats;
+#endif
+
+    //两端共享，由 bp_mutex 保护；depth 在 put 端锁内增加、取走后减少，用原子操作
+    size_t depth __MSGQUEUE_ALIGNED;  //两端合计的消息数，只有设置了水位回调才维护
+    pthread_mutex_t bp_mutex;
+    pthread_cond_t credit_cond;
+    size_t credits;         //还可以发放的信用，不超过 msg_max
+    size_t uncredited;      //恢复时超出信用入队的消息数，取走它们不归还信用
+    size_t credit_waiters;  //等待信用的线程数
+    int above;              //已经报告过高水位，还没报告回到低水位
 };
 
 void msgqueue_set_nonblock(msgqueue_t *queue)
@@ -36,108 +207,1837 @@ void msgqueue_set_block(msgqueue_t *queue)
 	queue->nonblock = 0;
 }
 
-static size_t __msgqueue_swap(msgqueue_t *queue)
+/* Absolute CLOCK_MONOTONIC time 'timeout_ns' from now, for timed waits. */
+static void __msgqueue_abstime(long long timeout_ns, struct timespec *abstime)
+{
+	clock_gettime(CLOCK_MONOTONIC, abstime);
+	if (timeout_ns < 0)
+		timeout_ns = 0;
+
+	abstime->tv_sec += timeout_ns / 1000000000;
+	abstime->tv_nsec += timeout_ns % 1000000000;
+	if (abstime->tv_nsec >= 1000000000)
+	{
+		abstime->tv_nsec -= 1000000000;
+		abstime->tv_sec++;
+	}
+}
+
+/* With put_mutex held, after 'cnt' messages are queued. Returns nonzero
+ * when the high watermark may have been reached; the caller then runs
+ * '__msgqueue_watermark' after unlocking. The count goes up before the
+ * messages can be taken, so it never drops below zero. */
+static int __msgqueue_added(msgqueue_t *queue, size_t cnt)
+{
+	size_t depth;
+
+	if (!queue->watermark)
+		return 0;
+
+	depth = __atomic_add_fetch(&queue->depth, cnt, __ATOMIC_RELAXED);
+	return depth >= queue->high_mark && !__atomic_load_n(&queue->above, __ATOMIC_RELAXED);
+}
+
+/* Report a watermark crossing, rechecked under bp_mutex so that the
+ * callbacks alternate even when puts and gets race. */
+static void __msgqueue_watermark(msgqueue_t *queue)
+{
+	size_t depth;
+
+	pthread_mutex_lock(&queue->bp_mutex);
+	depth = __atomic_load_n(&queue->depth, __ATOMIC_RELAXED);
+	if (!queue->above && depth >= queue->high_mark)
+	{
+		__atomic_store_n(&queue->above, 1, __ATOMIC_RELAXED);
+		queue->watermark(queue, MSGQUEUE_WATERMARK_HIGH, queue->watermark_ctx);
+	}
+	else if (queue->above && depth <= queue->low_mark)
+	{
+		__atomic_store_n(&queue->above, 0, __ATOMIC_RELAXED);
+		queue->watermark(queue, MSGQUEUE_WATERMARK_LOW, queue->watermark_ctx);
+	}
+	pthread_mutex_unlock(&queue->bp_mutex);
+}
+
+/* Give 'n' credits back, for messages taken when 'taken' is set. Messages
+ * restored without a credit give nothing back, and the count never goes
+ * above 'maxlen', so neither they nor a caller releasing more than it
+ * acquired can raise the limit for good. */
+static void __msgqueue_give_credits(msgqueue_t *queue, size_t n, int taken)
+{
+	size_t cnt;
+
+	pthread_mutex_lock(&queue->bp_mutex);
+	if (taken && queue->uncredited)
+	{
+		cnt = n < queue->uncredited ? n : queue->uncredited;
+		queue->uncredited -= cnt;
+		n -= cnt;
+	}
+
+	if (n > queue->msg_max - queue->credits)
+		n = queue->msg_max - queue->credits;
+
+	queue->credits += n;
+	if (n && queue->credit_waiters)
+	{
+		if (n == 1)
+			pthread_cond_signal(&queue->credit_cond);
+		else
+			pthread_cond_broadcast(&queue->credit_cond);
+	}
+	pthread_mutex_unlock(&queue->bp_mutex);
+}
+
+/* After 'cnt' messages are taken, outside the get lock: give their credits
+ * back and check the low watermark. */
+static void __msgqueue_taken(msgqueue_t *queue, size_t cnt)
+{
+	size_t depth;
+
+	if (cnt == 0)
+		return;
+
+	if (queue->credit_mode)
+		__msgqueue_give_credits(queue, cnt, 1);
+
+	if (queue->watermark)
+	{
+		depth = __atomic_sub_fetch(&queue->depth, cnt, __ATOMIC_RELAXED);
+		if (depth <= queue->low_mark && __atomic_load_n(&queue->above, __ATOMIC_RELAXED))
+			__msgqueue_watermark(queue);
+	}
+}
+
+#ifdef MARK_QUEUE_STATS
+static unsigned long long __msgqueue_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void __msgqueue_stat_inc(unsigned long long *counter, unsigned long long cnt)
+{
+	__atomic_fetch_add(counter, cnt, __ATOMIC_RELAXED);
+}
+
+/* With put_mutex held, after 'cnt' messages are queued. */
+static void __msgqueue_stat_put(msgqueue_t *queue, unsigned long long cnt)
+{
+	struct __msgqueue_stats *stats = &queue->stats;
+	unsigned long long puts = __atomic_add_fetch(&stats->puts, cnt, __ATOMIC_RELAXED);
+	unsigned long long depth = puts - __atomic_load_n(&stats->gets, __ATOMIC_RELAXED);
+
+	if (depth > stats->high_water && depth <= puts)
+		__atomic_store_n(&stats->high_water, depth, __ATOMIC_RELAXED);
+
+	/* Lanes reorder messages, so only a single lane queue is traced. */
+	if (queue->nlanes == 1 && puts / MSGQUEUE_SAMPLE_EVERY != (puts - cnt) / MSGQUEUE_SAMPLE_EVERY &&
+		__atomic_load_n(&stats->trace_seq, __ATOMIC_ACQUIRE) == 0)
+	{
+		stats->trace_stamp = __msgqueue_now();
+		__atomic_store_n(&stats->trace_seq, puts, __ATOMIC_RELEASE);
+	}
+}
+
+/* With get_mutex held, after 'cnt' messages are taken. */
+static void __msgqueue_stat_get(msgqueue_t *queue, unsigned long long cnt)
+{
+	struct __msgqueue_stats *stats = &queue->stats;
+	unsigned long long gets = __atomic_add_fetch(&stats->gets, cnt, __ATOMIC_RELAXED);
+	unsigned long long trace = __atomic_load_n(&stats->trace_seq, __ATOMIC_ACQUIRE);
+	unsigned long long ns;
+
+	if (trace && gets >= trace)
+	{
+		ns = __msgqueue_now() - stats->trace_stamp;
+		__msgqueue_stat_inc(&stats->sojourn_samples, 1);
+		__msgqueue_stat_inc(&stats->sojourn_total_ns, ns);
+		if (ns > stats->sojourn_max_ns)
+			__atomic_store_n(&stats->sojourn_max_ns, ns, __ATOMIC_RELAXED);
+
+		__atomic_store_n(&stats->trace_seq, 0, __ATOMIC_RELEASE);
+	}
+}
+#endif
+
+static unsigned long long __msgqueue_tick(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1000000000ULL + now.tv_nsec) / MSGQUEUE_WHEEL_TICK_NS;
+}
+
+static unsigned long long __msgqueue_deadline(msgqueue_t *queue, void **link)
+{
+	unsigned long long tick;
+
+	memcpy(&tick, (char *)link - queue->linkoff + queue->deadoff, sizeof tick);
+	return tick;
+}
+
+/* Put a message due at 'tick' (later than wheel->now) into its slot. */
+static void __msgqueue_wheel_link(struct __msgqueue_wheel *wheel, void **link, unsigned long long tick)
+{
+	unsigned long long delta = tick - wheel->now;
+	struct __msgqueue_slot *slot;
+	int level = 0;
+	int idx;
+
+	while (level < MSGQUEUE_WHEEL_LEVELS - 1 && (delta >> (MSGQUEUE_WHEEL_BITS * (level + 1))))
+		level++;
+
+	if (delta >> (MSGQUEUE_WHEEL_BITS * MSGQUEUE_WHEEL_LEVELS))
+		tick = wheel->now + (1ULL << (MSGQUEUE_WHEEL_BITS * MSGQUEUE_WHEEL_LEVELS)) - 1;
+
+	idx = (tick >> (MSGQUEUE_WHEEL_BITS * level)) & (MSGQUEUE_WHEEL_SLOTS - 1);
+	slot = &wheel->slots[level][idx];
+	*link = NULL;
+	*slot->tail = link;
+	slot->tail = link;
+	slot->cnt++;
+	wheel->bitmap[level] |= 1ULL << idx;
+}
+
+/* Detach a slot, returning its first link. */
+static void **__msgqueue_wheel_take(struct __msgqueue_wheel *wheel, int level, int idx)
+{
+	struct __msgqueue_slot *slot = &wheel->slots[level][idx];
+	void **first = (void **)slot->first;
+
+	slot->first = NULL;
+	slot->tail = &slot->first;
+	slot->cnt = 0;
+	wheel->bitmap[level] &= ~(1ULL << idx);
+	return first;
+}
+
+/* With put_mutex held: run the wheel up to the current tick and move the
+ * due messages onto the lowest lane. Returns how many became ready. */
+static size_t __msgqueue_wheel_advance(msgqueue_t *queue)
+{
+	struct __msgqueue_wheel *wheel = queue->wheel;
+	struct __msgqueue_list *lane = &queue->put_lists[queue->nlanes - 1];
+	unsigned long long target = __msgqueue_tick();
+	unsigned long long mask;
+	unsigned long long next;
+	struct __msgqueue_slot *slot;
+	void **link;
+	void **succ;
+	size_t cnt = 0;
+	int level;
+	int cur;
+
+	while (wheel->pending && wheel->now < target)
+	{
+		/* Next tick with a level 0 slot to expire or a block boundary. */
+		cur = wheel->now & (MSGQUEUE_WHEEL_SLOTS - 1);
+		mask = cur == MSGQUEUE_WHEEL_SLOTS - 1 ? 0 : wheel->bitmap[0] & (~0ULL << (cur + 1));
+		if (mask)
+			next = wheel->now - cur + __builtin_ctzll(mask);
+		else
+			next = (wheel->now | (MSGQUEUE_WHEEL_SLOTS - 1)) + 1;
+
+		if (next > target)
+			break;
+
+		wheel->now = next;
+		for (level = MSGQUEUE_WHEEL_LEVELS - 1; level > 0; level--)
+		{
+			if (next & ((1ULL << (MSGQUEUE_WHEEL_BITS * level)) - 1))
+				continue;
+
+			link = __msgqueue_wheel_take(wheel, level,
+						(next >> (MSGQUEUE_WHEEL_BITS * level)) & (MSGQUEUE_WHEEL_SLOTS - 1));
+			while (link)
+			{
+				succ = (void **)*link;
+				if (__msgqueue_deadline(queue, link) <= next)
+				{
+					*link = NULL;
+					*lane->tail = link;
+					lane->tail = link;
+					wheel->pending--;
+					cnt++;
+				}
+				else
+					__msgqueue_wheel_link(wheel, link, __msgqueue_deadline(queue, link));
+				link = succ;
+			}
+		}
+
+		slot = &wheel->slots[0][next & (MSGQUEUE_WHEEL_SLOTS - 1)];
+		if (slot->first)
+		{
+			*lane->tail = slot->first;
+			lane->tail = slot->tail;
+			wheel->pending -= slot->cnt;
+			cnt += slot->cnt;
+			__msgqueue_wheel_take(wheel, 0, next & (MSGQUEUE_WHEEL_SLOTS - 1));
+		}
+	}
+
+	if (wheel->now < target)
+		wheel->now = target;
+
+	if (cnt)
+	{
+		__atomic_store_n(&queue->put_mask, queue->put_mask | (1u << (queue->nlanes - 1)), __ATOMIC_RELAXED);
+		queue->msg_cnt += cnt;
+		__MSGQUEUE_STAT(__msgqueue_stat_put(queue, cnt));
+	}
+
+	return cnt;
+}
+
+/* The tick at which the wheel next has something to do: the earliest
+ * non-empty level 0 slot, or the start of the block of a non-empty slot
+ * of a higher level, where it gets cascaded. */
+static unsigned long long __msgqueue_wheel_next(struct __msgqueue_wheel *wheel)
 {
-	void **get_head = queue->get_head;
+	unsigned long long best = ~0ULL;
+	unsigned long long base;
+	unsigned long long rot;
+	unsigned long long bm;
+	unsigned long long tick;
+	int level;
+	int cur;
+
+	for (level = 0; level < MSGQUEUE_WHEEL_LEVELS; level++)
+	{
+		bm = wheel->bitmap[level];
+		if (!bm)
+			continue;
+
+		/* Rotate so that bit 0 is the slot right after the current one. */
+		base = wheel->now >> (MSGQUEUE_WHEEL_BITS * level);
+		cur = (base + 1) & (MSGQUEUE_WHEEL_SLOTS - 1);
+		rot = cur ? (bm >> cur) | (bm << (MSGQUEUE_WHEEL_SLOTS - cur)) : bm;
+		tick = (base + 1 + __builtin_ctzll(rot)) << (MSGQUEUE_WHEEL_BITS * level);
+		if (tick < best)
+			best = tick;
+	}
+
+	return best;
+}
+
+static void __msgqueue_tick_abstime(unsigned long long tick, struct timespec *abstime)
+{
+	unsigned long long ns = tick * MSGQUEUE_WHEEL_TICK_NS;
+
+	abstime->tv_sec = ns / 1000000000;
+	abstime->tv_nsec = ns % 1000000000;
+}
+
+/* 'abstime' NULL means wait until a message arrives. While delayed
+ * messages are pending, the wait is cut short at the wheel's next tick. */
+static size_t __msgqueue_swap(msgqueue_t *queue, const struct timespec *abstime)
+{
+	struct __msgqueue_list *put;
+	struct __msgqueue_list *get;
+	const struct timespec *wait;
+	struct timespec at;
+	size_t ready = 0;
 	size_t cnt;
+	int mark;
+	int ret;
+	int i;
 
-	queue->get_head = queue->put_head;
 	pthread_mutex_lock(&queue->put_mutex);
+	if (queue->wheel)
+		ready += __msgqueue_wheel_advance(queue);
+
+	__MSGQUEUE_STAT(if (queue->msg_cnt == 0 && !queue->nonblock)
+		__msgqueue_stat_inc(&queue->stats.blocked_gets, 1));
 	while (queue->msg_cnt == 0 && !queue->nonblock){
-		pthread_cond_wait(&queue->get_cond, &queue->put_mutex);
+		wait = abstime;
+		if (queue->wheel && queue->wheel->pending)
+		{
+			queue->wheel->wake = __msgqueue_wheel_next(queue->wheel);
+			__msgqueue_tick_abstime(queue->wheel->wake, &at);
+			if (!abstime || at.tv_sec < abstime->tv_sec ||
+				(at.tv_sec == abstime->tv_sec && at.tv_nsec < abstime->tv_nsec))
+				wait = &at;
+		}
+
+		if (!wait)
+			ret = pthread_cond_wait(&queue->get_cond, &queue->put_mutex);
+		else
+			ret = pthread_cond_timedwait(&queue->get_cond, &queue->put_mutex, wait);
+
+		if (queue->wheel)
+		{
+			queue->wheel->wake = ~0ULL;
+			ready += __msgqueue_wheel_advance(queue);
+		}
+
+		if (ret == ETIMEDOUT && wait == abstime)
+			break;
 	}
 
 	cnt = queue->msg_cnt;
+	__MSGQUEUE_STAT(if (cnt == 0)
+		__msgqueue_stat_inc(&queue->stats.empty_swaps, 1));
 	if (cnt > queue->msg_max - 1)
 		pthread_cond_broadcast(&queue->put_cond);
 
-	queue->put_head = get_head;
-	queue->put_tail = get_head;
+	/* Move every lane at once: splice its put list onto its get list. */
+	for (i = 0; i < queue->nlanes; i++)
+	{
+		put = &queue->put_lists[i];
+		if (put->first)
+		{
+			get = &queue->get_lists[i];
+			*get->tail = put->first;
+			get->tail = put->tail;
+			put->first = NULL;
+			put->tail = &put->first;
+		}
+	}
+
+	__atomic_store_n(&queue->put_mask, 0, __ATOMIC_RELAXED);
 	queue->msg_cnt = 0;
+	mark = ready ? __msgqueue_added(queue, ready) : 0;
 	pthread_mutex_unlock(&queue->put_mutex);
+	if (mark)
+		__msgqueue_watermark(queue);
 	return cnt;
 }
 
+/* Highest priority lane with messages on the get side, or -1. */
+static int __msgqueue_first(msgqueue_t *queue)
+{
+	int i;
 
+	for (i = 0; i < queue->nlanes; i++)
+	{
+		if (queue->get_lists[i].first)
+			return i;
+	}
 
-void msgqueue_put(void *msg,msgqueue_t *queue){
-    void **link=(void**)((char*)msg+queue->linkoff);  //*link的地址是消息的起始地址加偏移，结合main刻制是Count->next
+	return -1;
+}
 
-    *link=NULL;    //这个地址对应的指针（也就是next）被赋值为NULL
-    pthread_mutex_lock(&queue->put_mutex);
-    while(queue->msg_cnt>queue->msg_max-1&&!queue->nonblock){
-        pthread_cond_wait(&queue->put_cond,&queue->put_mutex);
-    }
+/* Pick the lane to serve, with get_mutex held. When 'swap' is set, new
+ * messages are swapped in if the get side is empty or a higher priority
+ * lane has pending puts. With aging on, every 'aging' picks that pass over
+ * lower priority messages serve the lowest non-empty lane instead. */
+static struct __msgqueue_list *__msgqueue_select(msgqueue_t *queue, int swap,
+												 const struct timespec *abstime)
+{
+	int best = __msgqueue_first(queue);
+	unsigned pending;
+	int low;
 
-    *queue->put_tail=link;   //里面的值赋值给尾指针
-    queue->put_tail=link;    //更新尾部指针指向link
-    queue->msg_cnt++;
-    pthread_mutex_unlock(&queue->put_mutex);
-    pthread_cond_signal(&queue->get_cond);
+	if (swap)
+	{
+		pending = __atomic_load_n(&queue->put_mask, __ATOMIC_RELAXED);
+		if (best < 0 || (pending & ((1u << best) - 1)))
+		{
+			__msgqueue_swap(queue, abstime);
+			best = __msgqueue_first(queue);
+		}
+	}
+
+	if (best < 0)
+		return NULL;
+
+	if (queue->aging)
+	{
+		low = queue->nlanes - 1;
+		while (!queue->get_lists[low].first)
+			low--;
+
+		if (low == best)
+			queue->starve = 0;
+		else if (++queue->starve >= queue->aging)
+		{
+			queue->starve = 0;
+			best = low;
+		}
+	}
+
+	return &queue->get_lists[best];
 }
 
-void *msgqueue_get(msgqueue_t *queue){
-    void *msg;
+static void *__msgqueue_pop(msgqueue_t *queue, struct __msgqueue_list *list)
+{
+	void **link = (void **)list->first;
 
-    pthread_mutex_lock(&queue->get_mutex);
-    if(*queue->get_head || __msgqueue_swap(queue)>0){
-        msg=(char*)*queue->get_head-queue->linkoff;
-        *queue->get_head=*(void**)*queue->get_head;
-    }else{
-        msg=NULL;
-    }
-    pthread_mutex_unlock(&queue->get_mutex);
-    return msg;
+	list->first = *link;
+	if (!list->first)
+		list->tail = &list->first;
+
+	return (char *)link - queue->linkoff;
 }
 
-msgqueue_t *msgqueue_create(size_t maxlen, int linkoff)
+/* Clamp a priority to an existing lane, and return its put list. */
+static struct __msgqueue_list *__msgqueue_lane(msgqueue_t *queue, int prio)
 {
-	msgqueue_t *queue = (msgqueue_t *)malloc(sizeof (msgqueue_t));
+	if (prio < 0)
+		prio = 0;
+	else if (prio >= queue->nlanes)
+		prio = queue->nlanes - 1;
+
+	__atomic_store_n(&queue->put_mask, queue->put_mask | (1u << prio), __ATOMIC_RELAXED);
+	return &queue->put_lists[prio];
+}
+
+static unsigned int __msgqueue_checksum(const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	unsigned long long h = 14695981039346656037ULL ^ size;
+	unsigned long long word;
+
+	/* FNV-1a over 8-byte words, only meant to catch torn records. Never 0,
+	 * so that a valid header is never all zero. */
+	for (; size >= sizeof word; size -= sizeof word, p += sizeof word)
+	{
+		memcpy(&word, p, sizeof word);
+		h = (h ^ word) * 1099511628211ULL;
+	}
+
+	while (size--)
+		h = (h ^ *p++) * 1099511628211ULL;
+
+	h ^= h >> 32;
+	return (unsigned int)h ? (unsigned int)h : 1;
+}
+
+static size_t __msgqueue_record_size(size_t size)
+{
+	return sizeof (struct __msgqueue_record) + ((size + 7) & ~(size_t)7);
+}
+
+/* Offset where a record of 'len' bytes goes when the previous one ends at
+ * 'pos': 'pos' itself, or the start of the next segment. */
+static unsigned long long __msgqueue_record_at(struct __msgqueue_journal *journal,
+											   unsigned long long pos, size_t len)
+{
+	size_t off = pos % journal->seg_size;
+
+	if (off + len > journal->seg_size)
+		pos += journal->seg_size - off;
+
+	return pos;
+}
+
+static void __msgqueue_journal_error(struct __msgqueue_journal *journal, int error)
+{
+	pthread_mutex_lock(&journal->mutex);
+	if (!journal->error)
+		journal->error = error;
+	pthread_cond_broadcast(&journal->sync_cond);
+	pthread_mutex_unlock(&journal->mutex);
+}
+
+/* Map segment 'index', creating it when 'create' is set. New segments get
+ * their blocks allocated up front, so that a full disk fails here and not
+ * with SIGBUS on a later store. */
+static struct __msgqueue_segment *__msgqueue_segment_open(struct __msgqueue_journal *journal,
+														  unsigned long long index, int create)
+{
+	struct __msgqueue_segment *seg;
+	struct stat st;
+	char name[32];
+	void *base;
 	int ret;
+	int fd;
 
-	if (!queue)
+	snprintf(name, sizeof name, "%016llx.seg", index);
+	fd = openat(journal->dirfd, name, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+	if (fd < 0)
 		return NULL;
 
-	ret = pthread_mutex_init(&queue->get_mutex, NULL);
+	ret = fstat(fd, &st) < 0 ? errno : 0;
+	if (ret == 0 && (size_t)st.st_size != journal->seg_size)
+	{
+		if (st.st_size != 0)
+			ret = EINVAL;	/* opened with another segment size */
+		else
+			ret = posix_fallocate(fd, 0, journal->seg_size);
+	}
+
 	if (ret == 0)
 	{
-		ret = pthread_mutex_init(&queue->put_mutex, NULL);
-		if (ret == 0)
+		base = mmap(NULL, journal->seg_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (base != MAP_FAILED)
 		{
-			ret = pthread_cond_init(&queue->get_cond, NULL);
-			if (ret == 0)
+			seg = (struct __msgqueue_segment *)malloc(sizeof (struct __msgqueue_segment));
+			if (seg)
 			{
-				ret = pthread_cond_init(&queue->put_cond, NULL);
-				if (ret == 0)
-				{
-					queue->msg_max = maxlen;
-					queue->linkoff = linkoff;
-					queue->head1 = NULL;
-					queue->head2 = NULL;
-					queue->get_head = &queue->head1;
-					queue->put_head = &queue->head2;
-					queue->put_tail = &queue->head2;
-					queue->msg_cnt = 0;
-					queue->nonblock = 0;
-					return queue;
-				}
-
-				pthread_cond_destroy(&queue->get_cond);
+				seg->index = index;
+				seg->fd = fd;
+				seg->base = (char *)base;
+				seg->synced = 0;
+				seg->end = journal->seg_size;
+				seg->next = NULL;
+				return seg;
 			}
 
-			pthread_mutex_destroy(&queue->put_mutex);
+			ret = ENOMEM;
+			munmap(base, journal->seg_size);
 		}
-
-		pthread_mutex_destroy(&queue->get_mutex);
+		else
+			ret = errno;
 	}
 
-	//errno = ret;
-	free(queue);
+	close(fd);
+	errno = ret;
 	return NULL;
 }
 
+static void __msgqueue_segment_close(struct __msgqueue_journal *journal,
+									 struct __msgqueue_segment *seg)
+{
+	munmap(seg->base, journal->seg_size);
+	close(seg->fd);
+	free(seg);
+}
+
+/* Make the first 'end' bytes of a segment durable. */
+static int __msgqueue_segment_sync(struct __msgqueue_journal *journal,
+								   struct __msgqueue_segment *seg, size_t end)
+{
+	size_t from = seg->synced & ~(journal->page_size - 1);
+
+	if (end <= seg->synced)
+		return 0;
+
+	if (msync(seg->base + from, end - from, MS_SYNC) < 0)
+		return -1;
+
+	seg->synced = end;
+	return 0;
+}
+
+/* With put_mutex held, right before 'msg' is linked, so that records are
+ * in queue order. A failure stops the journal at the current offset. */
+static void __msgqueue_journal_append(msgqueue_t *queue, const void *msg)
+{
+	struct __msgqueue_journal *journal = queue->journal;
+	struct __msgqueue_segment *seg;
+	struct __msgqueue_record rec;
+	unsigned long long pos;
+	size_t size;
+	size_t len;
+	char *p;
+	int ret = 0;
+
+	if (__atomic_load_n(&journal->limit, __ATOMIC_RELAXED) != ~0ULL)
+		return;
+
+	size = journal->size(msg);
+	len = __msgqueue_record_size(size);
+	pos = __msgqueue_record_at(journal, journal->written, len);
+	seg = journal->active;
+	if (len > journal->seg_size || size > 0xffffffffu)
+		ret = EMSGSIZE;
+	else if (!seg || seg->index != pos / journal->seg_size)
+	{
+		/* Normally the flusher has the next segment mapped already and
+		 * rotating is a pointer swap. Otherwise it is created here, with
+		 * every put waiting. */
+		pthread_mutex_lock(&journal->mutex);
+		seg = journal->spare;
+		if (seg && seg->index == pos / journal->seg_size)
+			journal->spare = NULL;
+		else
+		{
+			pthread_mutex_unlock(&journal->mutex);
+			seg = __msgqueue_segment_open(journal, pos / journal->seg_size, 1);
+			ret = seg ? 0 : errno;
+			pthread_mutex_lock(&journal->mutex);
+			journal->dir_dirty = 1;
+		}
+
+		if (seg)
+		{
+			if (journal->active)
+			{
+				journal->active->end = journal->written - journal->active->index * journal->seg_size;
+				journal->active->next = journal->sealed;
+				journal->sealed = journal->active;
+			}
+			journal->active = seg;
+			journal->prepare = 1;
+			pthread_cond_signal(&journal->flush_cond);
+		}
+		pthread_mutex_unlock(&journal->mutex);
+	}
+
+	if (ret != 0)
+	{
+		__atomic_store_n(&journal->limit, journal->written, __ATOMIC_RELAXED);
+		__msgqueue_journal_error(journal, ret);
+		return;
+	}
+
+	p = seg->base + pos % journal->seg_size;
+	rec.size = (unsigned int)size;
+	rec.check = __msgqueue_checksum(msg, size);
+	memcpy(p + sizeof rec, msg, size);
+	memcpy(p, &rec, sizeof rec);
+	__atomic_store_n(&journal->written, pos + len, __ATOMIC_RELEASE);
+}
+
+/* With get_mutex held, for each message taken in queue order. */
+static void __msgqueue_journal_consume(msgqueue_t *queue, const void *msg)
+{
+	struct __msgqueue_journal *journal = queue->journal;
+	size_t len;
+
+	if (journal->consumed >= __atomic_load_n(&journal->limit, __ATOMIC_RELAXED))
+		return;
+
+	len = __msgqueue_record_size(journal->size(msg));
+	journal->consumed = __msgqueue_record_at(journal, journal->consumed, len) + len;
+}
+
+/* One group commit, called by the flusher with journal->mutex held; the
+ * lock is dropped while the disk is written. Everything put before the
+ * round started is durable when it completes. */
+static void __msgqueue_journal_flush(struct __msgqueue_journal *journal)
+{
+	struct __msgqueue_segment *sealed;
+	struct __msgqueue_segment *active;
+	struct __msgqueue_segment *spare = NULL;
+	struct __msgqueue_segment *seg;
+	unsigned long long written;
+	unsigned long long next = 0;
+	unsigned long long committed;
+	unsigned long long index;
+	unsigned long long round;
+	unsigned long long base;
+	int dir_dirty;
+	int error = 0;
+	char name[32];
+
+	round = ++journal->rounds;
+	journal->wanted = 0;
+	written = __atomic_load_n(&journal->written, __ATOMIC_ACQUIRE);
+	active = journal->active;
+	sealed = journal->sealed;
+	journal->sealed = NULL;
+	dir_dirty = journal->dir_dirty;
+	journal->dir_dirty = 0;
+	committed = journal->committed;
+	index = journal->oldest;
+	journal->prepare = 0;
+	if (active && !journal->stop && !journal->spare)
+		next = active->index + 1;
+	pthread_mutex_unlock(&journal->mutex);
+
+	/* Map the segment after the active one and hand it over before the
+	 * disk writes below, which can take longer than filling a segment. A
+	 * failure is left for the put that needs the segment to report. A
+	 * file left behind is not removed here, since a put may be creating
+	 * the same segment right now; recovery drops it if it stays empty. */
+	if (next)
+	{
+		spare = __msgqueue_segment_open(journal, next, 1);
+		if (spare)
+		{
+			pthread_mutex_lock(&journal->mutex);
+			/* A put may have created the segment itself meanwhile. */
+			if (!journal->spare && journal->active && journal->active->index + 1 == spare->index)
+			{
+				journal->spare = spare;
+				journal->dir_dirty = 1;
+				spare = NULL;
+			}
+			pthread_mutex_unlock(&journal->mutex);
+			if (spare)
+				__msgqueue_segment_close(journal, spare);
+		}
+	}
+
+	while (sealed)
+	{
+		seg = sealed;
+		sealed = seg->next;
+		if (__msgqueue_segment_sync(journal, seg, seg->end) < 0 && !error)
+			error = errno;
+		__msgqueue_segment_close(journal, seg);
+	}
+
+	if (active)
+	{
+		base = active->index * journal->seg_size;
+		if (written > base && __msgqueue_segment_sync(journal, active, written - base) < 0 && !error)
+			error = errno;
+	}
+
+	if (dir_dirty && fsync(journal->dirfd) < 0 && !error)
+		error = errno;
+
+	if (committed != journal->persisted)
+	{
+		if (pwrite(journal->commitfd, &committed, sizeof committed, 0) != sizeof committed ||
+			fdatasync(journal->commitfd) < 0)
+		{
+			if (!error)
+				error = errno ? errno : EIO;
+		}
+		else
+			journal->persisted = committed;
+	}
+
+	/* Segments wholly before the commit are no longer needed. */
+	for (; index < journal->persisted / journal->seg_size; index++)
+	{
+		snprintf(name, sizeof name, "%016llx.seg", index);
+		if (unlinkat(journal->dirfd, name, 0) < 0 && errno != ENOENT && !error)
+			error = errno;
+	}
+
+	pthread_mutex_lock(&journal->mutex);
+	journal->oldest = index;
+	if (error && !journal->error)
+		journal->error = error;
+	journal->done = round;
+	pthread_cond_broadcast(&journal->sync_cond);
+}
+
+static void *__msgqueue_flusher(void *arg)
+{
+	struct __msgqueue_journal *journal = (struct __msgqueue_journal *)arg;
+	struct timespec abstime;
+	int stop;
+
+	pthread_mutex_lock(&journal->mutex);
+	do
+	{
+		if (!journal->wanted && !journal->stop && !journal->prepare)
+		{
+			__msgqueue_abstime(journal->interval_ns, &abstime);
+			pthread_cond_timedwait(&journal->flush_cond, &journal->mutex, &abstime);
+		}
+
+		/* The last round runs after the stop request. */
+		stop = journal->stop;
+		__msgqueue_journal_flush(journal);
+	} while (!stop);
+	pthread_mutex_unlock(&journal->mutex);
+	return NULL;
+}
+
+void msgqueue_put(void *msg, msgqueue_t *queue)
+{
+	msgqueue_put_prio(msg, queue->nlanes - 1, queue);
+}
+
+void msgqueue_put_prio(void *msg,int prio,msgqueue_t *queue){
+    void **link=(void**)((char*)msg+queue->linkoff);  //*link的地址是消息的起始地址加偏移，结合main刻制是Count->next
+    struct __msgqueue_list *lane;
+    int mark;
+
+    *link=NULL;    //这个地址对应的指针（也就是next）被赋值为NULL
+    pthread_mutex_lock(&queue->put_mutex);
+    __MSGQUEUE_STAT(if(queue->msg_cnt>queue->msg_max-1&&!queue->nonblock)
+        __msgqueue_stat_inc(&queue->stats.blocked_puts,1));
+    while(queue->msg_cnt>queue->msg_max-1&&!queue->nonblock){
+        pthread_cond_wait(&queue->put_cond,&queue->put_mutex);
+    }
+
+    if(queue->journal)
+        __msgqueue_journal_append(queue,msg);   //和入队在同一把锁里，日志顺序就是队列顺序
+    lane=__msgqueue_lane(queue,prio);
+    *lane->tail=link;    //里面的值赋值给尾指针
+    lane->tail=link;     //更新尾部指针指向link
+    queue->msg_cnt++;
+    __MSGQUEUE_STAT(__msgqueue_stat_put(queue,1));
+    mark=__msgqueue_added(queue,1);
+    pthread_mutex_unlock(&queue->put_mutex);
+    pthread_cond_signal(&queue->get_cond);
+    if(mark)
+        __msgqueue_watermark(queue);
+}
+
+void *msgqueue_get(msgqueue_t *queue){
+    struct __msgqueue_list *lane;
+    void *msg;
+
+    pthread_mutex_lock(&queue->get_mutex);
+    lane=__msgqueue_select(queue,1,NULL);   //总是取优先级最高的非空通道
+    if(lane){
+        msg=__msgqueue_pop(queue,lane);
+        if(queue->journal)
+            __msgqueue_journal_consume(queue,msg);
+        __MSGQUEUE_STAT(__msgqueue_stat_get(queue,1));
+    }else{
+        msg=NULL;
+    }
+    pthread_mutex_unlock(&queue->get_mutex);
+    if(msg)
+        __msgqueue_taken(queue,1);
+    return msg;
+}
+
+void msgqueue_put_batch(void *msgs, msgqueue_t *queue)
+{
+	struct __msgqueue_list *lane;
+	void **first;
+	void **link;
+	void **next;
+	size_t cnt = 1;
+	int mark;
+
+	if (!msgs)
+		return;
+
+	/* Turn message pointers into link pointers outside the lock. */
+	first = (void **)((char *)msgs + queue->linkoff);
+	link = first;
+	while (*link)
+	{
+		next = (void **)((char *)*link + queue->linkoff);
+		*link = next;
+		link = next;
+		cnt++;
+	}
+
+	pthread_mutex_lock(&queue->put_mutex);
+	__MSGQUEUE_STAT(if (queue->msg_cnt > queue->msg_max - 1 && !queue->nonblock)
+		__msgqueue_stat_inc(&queue->stats.blocked_puts, 1));
+	while (queue->msg_cnt > queue->msg_max - 1 && !queue->nonblock)
+		pthread_cond_wait(&queue->put_cond, &queue->put_mutex);
+
+	if (queue->journal)
+	{
+		for (next = first; next; next = (void **)*next)
+			__msgqueue_journal_append(queue, (char *)next - queue->linkoff);
+	}
+
+	lane = __msgqueue_lane(queue, queue->nlanes - 1);
+	*lane->tail = first;
+	lane->tail = link;
+	queue->msg_cnt += cnt;
+	__MSGQUEUE_STAT(__msgqueue_stat_put(queue, cnt));
+	mark = __msgqueue_added(queue, cnt);
+	pthread_mutex_unlock(&queue->put_mutex);
+	pthread_cond_signal(&queue->get_cond);
+	if (mark)
+		__msgqueue_watermark(queue);
+}
+
+size_t msgqueue_get_batch(msgqueue_t *queue, void **msgs, size_t max)
+{
+	struct __msgqueue_list *lane;
+	size_t cnt = 0;
+
+	if (max == 0)
+		return 0;
+
+	pthread_mutex_lock(&queue->get_mutex);
+	lane = __msgqueue_select(queue, 1, NULL);
+	while (lane)
+	{
+		msgs[cnt] = __msgqueue_pop(queue, lane);
+		if (queue->journal)
+			__msgqueue_journal_consume(queue, msgs[cnt]);
+		if (++cnt == max)
+			break;
+
+		lane = __msgqueue_select(queue, 0, NULL);
+	}
+	__MSGQUEUE_STAT(if (cnt)
+		__msgqueue_stat_get(queue, cnt));
+	pthread_mutex_unlock(&queue->get_mutex);
+	__msgqueue_taken(queue, cnt);
+	return cnt;
+}
+
+void *msgqueue_get_all(msgqueue_t *queue)
+{
+	struct __msgqueue_list *lane;
+	void *head = NULL;
+	void **tail = &head;
+	void **link;
+	void **next;
+	void *msgs;
+	size_t cnt;
+	int i;
+
+	pthread_mutex_lock(&queue->get_mutex);
+	if (__msgqueue_first(queue) < 0 || __atomic_load_n(&queue->put_mask, __ATOMIC_RELAXED))
+		__msgqueue_swap(queue, NULL);
+
+	/* Concatenate all lanes, highest priority first. */
+	for (i = 0; i < queue->nlanes; i++)
+	{
+		lane = &queue->get_lists[i];
+		if (lane->first)
+		{
+			*tail = lane->first;
+			tail = lane->tail;
+			lane->first = NULL;
+			lane->tail = &lane->first;
+		}
+	}
+	if (queue->journal)
+	{
+		for (link = (void **)head; link; link = (void **)*link)
+			__msgqueue_journal_consume(queue, (char *)link - queue->linkoff);
+	}
+#ifdef MARK_QUEUE_STATS
+	if (head)
+	{
+		unsigned long long cnt = 1;
+
+		for (link = (void **)head; *link; link = (void **)*link)
+			cnt++;
+		__msgqueue_stat_get(queue, cnt);
+	}
+#endif
+	pthread_mutex_unlock(&queue->get_mutex);
+
+	link = (void **)head;
+
+	if (!link)
+		return NULL;
+
+	/* Turn link pointers back into message pointers outside the lock. */
+	msgs = (char *)link - queue->linkoff;
+	cnt = 1;
+	while (*link)
+	{
+		next = (void **)*link;
+		*link = (char *)next - queue->linkoff;
+		link = next;
+		cnt++;
+	}
+
+	__msgqueue_taken(queue, cnt);
+	return msgs;
+}
+
+void *msgqueue_get_timed(msgqueue_t *queue, long long timeout_ns)
+{
+	struct __msgqueue_list *lane;
+	struct timespec abstime;
+	void *msg;
+
+	__msgqueue_abstime(timeout_ns, &abstime);
+	pthread_mutex_lock(&queue->get_mutex);
+	lane = __msgqueue_select(queue, 1, &abstime);
+	if (lane)
+	{
+		msg = __msgqueue_pop(queue, lane);
+		if (queue->journal)
+			__msgqueue_journal_consume(queue, msg);
+		__MSGQUEUE_STAT(__msgqueue_stat_get(queue, 1));
+	}
+	else
+		msg = NULL;
+
+	pthread_mutex_unlock(&queue->get_mutex);
+	if (msg)
+		__msgqueue_taken(queue, 1);
+	return msg;
+}
+
+int msgqueue_put_timed(void *msg, long long timeout_ns, msgqueue_t *queue)
+{
+	void **link = (void **)((char *)msg + queue->linkoff);
+	struct __msgqueue_list *lane;
+	struct timespec abstime;
+	int mark;
+
+	__msgqueue_abstime(timeout_ns, &abstime);
+	*link = NULL;
+	pthread_mutex_lock(&queue->put_mutex);
+	__MSGQUEUE_STAT(if (queue->msg_cnt > queue->msg_max - 1 && !queue->nonblock)
+		__msgqueue_stat_inc(&queue->stats.blocked_puts, 1));
+	while (queue->msg_cnt > queue->msg_max - 1 && !queue->nonblock)
+	{
+		if (pthread_cond_timedwait(&queue->put_cond, &queue->put_mutex, &abstime) == ETIMEDOUT &&
+			queue->msg_cnt > queue->msg_max - 1 && !queue->nonblock)
+		{
+			pthread_mutex_unlock(&queue->put_mutex);
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+
+	if (queue->journal)
+		__msgqueue_journal_append(queue, msg);
+
+	lane = __msgqueue_lane(queue, queue->nlanes - 1);
+	*lane->tail = link;
+	lane->tail = link;
+	queue->msg_cnt++;
+	__MSGQUEUE_STAT(__msgqueue_stat_put(queue, 1));
+	mark = __msgqueue_added(queue, 1);
+	pthread_mutex_unlock(&queue->put_mutex);
+	pthread_cond_signal(&queue->get_cond);
+	if (mark)
+		__msgqueue_watermark(queue);
+	return 0;
+}
+
+int msgqueue_try_put(void *msg, msgqueue_t *queue)
+{
+	void **link = (void **)((char *)msg + queue->linkoff);
+	struct __msgqueue_list *lane;
+	int mark;
+
+	if (queue->credit_mode)
+	{
+		if (msgqueue_acquire_credits(queue, 1, 0) == 0)
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+
+	*link = NULL;
+	pthread_mutex_lock(&queue->put_mutex);
+	if (queue->msg_cnt > queue->msg_max - 1 && !queue->credit_mode)
+	{
+		pthread_mutex_unlock(&queue->put_mutex);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	if (queue->journal)
+		__msgqueue_journal_append(queue, msg);
+
+	lane = __msgqueue_lane(queue, queue->nlanes - 1);
+	*lane->tail = link;
+	lane->tail = link;
+	queue->msg_cnt++;
+	__MSGQUEUE_STAT(__msgqueue_stat_put(queue, 1));
+	mark = __msgqueue_added(queue, 1);
+	pthread_mutex_unlock(&queue->put_mutex);
+	pthread_cond_signal(&queue->get_cond);
+	if (mark)
+		__msgqueue_watermark(queue);
+	return 0;
+}
+
+int msgqueue_put_at(void *msg, long long deadline_ns, msgqueue_t *queue)
+{
+	void **link = (void **)((char *)msg + queue->linkoff);
+	struct __msgqueue_wheel *wheel;
+	struct __msgqueue_list *lane;
+	unsigned long long tick;
+	int signal = 0;
+	int mark = 0;
+	int level;
+	int i;
+
+	/* Journal offsets follow the queue order, which delayed messages break.
+	 * Without a deadline offset there is no agreed place to keep the tick. */
+	if (queue->journal || !queue->has_deadoff)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (deadline_ns < 0)
+		deadline_ns = 0;
+
+	/* Round up, so that a message is never delivered early. */
+	tick = ((unsigned long long)deadline_ns + MSGQUEUE_WHEEL_TICK_NS - 1) / MSGQUEUE_WHEEL_TICK_NS;
+	memcpy((char *)msg + queue->deadoff, &tick, sizeof tick);
+	*link = NULL;
+
+	pthread_mutex_lock(&queue->put_mutex);
+	wheel = queue->wheel;
+	if (!wheel)
+	{
+		wheel = (struct __msgqueue_wheel *)malloc(sizeof (struct __msgqueue_wheel));
+		if (!wheel)
+		{
+			pthread_mutex_unlock(&queue->put_mutex);
+			errno = ENOMEM;
+			return -1;
+		}
+
+		for (level = 0; level < MSGQUEUE_WHEEL_LEVELS; level++)
+		{
+			wheel->bitmap[level] = 0;
+			for (i = 0; i < MSGQUEUE_WHEEL_SLOTS; i++)
+			{
+				wheel->slots[level][i].first = NULL;
+				wheel->slots[level][i].tail = &wheel->slots[level][i].first;
+				wheel->slots[level][i].cnt = 0;
+			}
+		}
+
+		wheel->pending = 0;
+		wheel->wake = ~0ULL;
+		wheel->now = __msgqueue_tick();
+		queue->wheel = wheel;
+	}
+	else if (!wheel->pending)
+		wheel->now = __msgqueue_tick();
+
+	if (tick <= wheel->now)
+	{
+		lane = __msgqueue_lane(queue, queue->nlanes - 1);
+		*lane->tail = link;
+		lane->tail = link;
+		queue->msg_cnt++;
+		__MSGQUEUE_STAT(__msgqueue_stat_put(queue, 1));
+		mark = __msgqueue_added(queue, 1);
+		signal = 1;
+	}
+	else
+	{
+		__msgqueue_wheel_link(wheel, link, tick);
+		wheel->pending++;
+		/* Wake the consumer if it sleeps past the new deadline. */
+		signal = tick < wheel->wake;
+	}
+	pthread_mutex_unlock(&queue->put_mutex);
+	if (signal)
+		pthread_cond_signal(&queue->get_cond);
+	if (mark)
+		__msgqueue_watermark(queue);
+	return 0;
+}
+
+size_t msgqueue_acquire_credits(msgqueue_t *queue, size_t n, long long timeout_ns)
+{
+	struct timespec abstime;
+	size_t cnt;
+
+	if (!queue->credit_mode)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	if (n == 0)
+		return 0;
+
+	if (timeout_ns > 0)
+		__msgqueue_abstime(timeout_ns, &abstime);
+
+	pthread_mutex_lock(&queue->bp_mutex);
+	while (queue->credits == 0 && timeout_ns != 0)
+	{
+		queue->credit_waiters++;
+		if (timeout_ns < 0)
+			pthread_cond_wait(&queue->credit_cond, &queue->bp_mutex);
+		else if (pthread_cond_timedwait(&queue->credit_cond, &queue->bp_mutex, &abstime) == ETIMEDOUT)
+			timeout_ns = 0;
+		queue->credit_waiters--;
+	}
+
+	cnt = n < queue->credits ? n : queue->credits;
+	queue->credits -= cnt;
+	pthread_mutex_unlock(&queue->bp_mutex);
+	if (cnt == 0)
+		errno = ETIMEDOUT;
+
+	return cnt;
+}
+
+void msgqueue_release_credits(msgqueue_t *queue, size_t n)
+{
+	if (!queue->credit_mode || n == 0)
+		return;
+
+	__msgqueue_give_credits(queue, n, 0);
+}
+
+void msgqueue_set_watermarks(msgqueue_t *queue, size_t low, size_t high,
+							 msgqueue_watermark_t callback, void *context)
+{
+	pthread_mutex_lock(&queue->bp_mutex);
+	queue->low_mark = low;
+	queue->high_mark = high;
+	queue->watermark_ctx = context;
+	queue->watermark = callback;
+	queue->above = 0;
+	pthread_mutex_unlock(&queue->bp_mutex);
+}
+
+/* Find the lowest and highest segment numbers in the journal directory.
+ * Returns the number of segment files, or -1. */
+static int __msgqueue_journal_scan(struct __msgqueue_journal *journal,
+								   unsigned long long *lo, unsigned long long *hi)
+{
+	struct dirent *entry;
+	unsigned long long index;
+	char *end;
+	DIR *dir;
+	int fd;
+	int cnt = 0;
+
+	fd = dup(journal->dirfd);
+	if (fd < 0)
+		return -1;
+
+	dir = fdopendir(fd);
+	if (!dir)
+	{
+		close(fd);
+		return -1;
+	}
+
+	rewinddir(dir);
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (strlen(entry->d_name) != 20 || strcmp(entry->d_name + 16, ".seg") != 0)
+			continue;
+
+		index = strtoull(entry->d_name, &end, 16);
+		if (end != entry->d_name + 16)
+			continue;
+
+		if (cnt == 0 || index < *lo)
+			*lo = index;
+		if (cnt == 0 || index > *hi)
+			*hi = index;
+		cnt++;
+	}
+
+	closedir(dir);
+	return cnt;
+}
+
+/* Queue again the messages after the committed offset, and position both
+ * sides. A torn record ends the journal: the rest of its segment is zeroed
+ * and later segments, which cannot have been synced before it, are
+ * removed. Returns the number of restored messages, or -1. */
+static long __msgqueue_journal_recover(msgqueue_t *queue, struct __msgqueue_journal *journal,
+									   msgqueue_restore_t restore, void *context)
+{
+	struct __msgqueue_segment *seg = NULL;
+	struct __msgqueue_record rec;
+	unsigned long long committed;
+	unsigned long long index;
+	unsigned long long pos;
+	unsigned long long lo = 0;
+	unsigned long long hi = 0;
+	struct stat st;
+	void *head = NULL;
+	void **tail = &head;
+	void **link;
+	void *msg;
+	size_t off;
+	size_t len;
+	long cnt = 0;
+	int found;
+	int mark;
+	int ret = 0;
+	char name[32];
+
+	if (pread(journal->commitfd, &committed, sizeof committed, 0) != sizeof committed)
+		committed = 0;
+
+	found = __msgqueue_journal_scan(journal, &lo, &hi);
+	if (found < 0)
+		return -1;
+
+	/* A last segment without any record was made ahead of time by the
+	 * flusher, or its first put never happened. Appending must resume
+	 * right after the last record, where the get side will look for the
+	 * next one, so such segments are dropped. So are segments shorter
+	 * than seg_size: creating them failed before anything was written. */
+	while (hi > lo)
+	{
+		snprintf(name, sizeof name, "%016llx.seg", hi);
+		if (fstatat(journal->dirfd, name, &st, 0) < 0)
+			break;
+
+		if ((size_t)st.st_size >= journal->seg_size)
+		{
+			seg = __msgqueue_segment_open(journal, hi, 0);
+			if (!seg)
+				break;
+
+			memcpy(&rec, seg->base, sizeof rec);
+			__msgqueue_segment_close(journal, seg);
+			seg = NULL;
+			if (rec.size != 0 || rec.check != 0)
+				break;
+		}
+
+		if (unlinkat(journal->dirfd, name, 0) < 0)
+			break;
+		hi--;
+	}
+
+	/* Segments before the first one left were all consumed. */
+	if (found && committed < lo * journal->seg_size)
+		committed = lo * journal->seg_size;
+
+	pos = committed;
+
+	while (found && pos / journal->seg_size <= hi)
+	{
+		index = pos / journal->seg_size;
+		off = pos % journal->seg_size;
+		if (!seg || seg->index != index)
+		{
+			if (seg)
+				__msgqueue_segment_close(journal, seg);
+
+			seg = __msgqueue_segment_open(journal, index, 0);
+			if (!seg)
+			{
+				if (errno != ENOENT)
+					ret = errno;
+				break;
+			}
+		}
+
+		if (off + sizeof rec > journal->seg_size)
+		{
+			pos += journal->seg_size - off;
+			continue;
+		}
+
+		memcpy(&rec, seg->base + off, sizeof rec);
+		if (rec.size == 0 && rec.check == 0)
+		{
+			if (index == hi)
+				break;
+
+			pos += journal->seg_size - off;
+			continue;
+		}
+
+		len = __msgqueue_record_size(rec.size);
+		if (off + len > journal->seg_size ||
+			rec.check != __msgqueue_checksum(seg->base + off + sizeof rec, rec.size))
+		{
+			off &= ~(journal->page_size - 1);
+			memset(seg->base + pos % journal->seg_size, 0, journal->seg_size - pos % journal->seg_size);
+			if (msync(seg->base + off, journal->seg_size - off, MS_SYNC) < 0)
+				ret = errno;
+			for (index++; index <= hi; index++)
+			{
+				snprintf(name, sizeof name, "%016llx.seg", index);
+				if (unlinkat(journal->dirfd, name, 0) < 0 && errno != ENOENT)
+					ret = errno;
+			}
+			break;
+		}
+
+		msg = restore(seg->base + off + sizeof rec, rec.size, context);
+		if (!msg)
+		{
+			ret = ECANCELED;
+			break;
+		}
+
+		link = (void **)((char *)msg + queue->linkoff);
+		*link = NULL;
+		*tail = link;
+		tail = link;
+		cnt++;
+		pos += len;
+	}
+
+	if (seg && (ret != 0 || seg->index != pos / journal->seg_size))
+	{
+		__msgqueue_segment_close(journal, seg);
+		seg = NULL;
+	}
+
+	if (head)
+	{
+		/* Restored messages use up credits like puts. Those beyond the
+		 * credits left are remembered, so that taking them gives nothing
+		 * back. Done before they can be taken. */
+		if (queue->credit_mode)
+		{
+			pthread_mutex_lock(&queue->bp_mutex);
+			if ((size_t)cnt > queue->credits)
+			{
+				queue->uncredited += (size_t)cnt - queue->credits;
+				queue->credits = 0;
+			}
+			else
+				queue->credits -= (size_t)cnt;
+			pthread_mutex_unlock(&queue->bp_mutex);
+		}
+
+		pthread_mutex_lock(&queue->put_mutex);
+		*queue->put_lists[0].tail = head;
+		queue->put_lists[0].tail = tail;
+		__msgqueue_lane(queue, 0);
+		queue->msg_cnt += cnt;
+		mark = __msgqueue_added(queue, cnt);
+		pthread_mutex_unlock(&queue->put_mutex);
+		if (mark)
+			__msgqueue_watermark(queue);
+	}
+
+	if (ret != 0)
+	{
+		errno = ret;
+		return -1;
+	}
+
+	journal->active = seg;
+	journal->written = pos;
+	journal->consumed = committed;
+	journal->committed = committed;
+	journal->persisted = committed;
+	journal->oldest = found ? lo : pos / journal->seg_size;
+	return cnt;
+}
+
+static void __msgqueue_journal_close(struct __msgqueue_journal *journal)
+{
+	char name[32];
+
+	pthread_mutex_lock(&journal->mutex);
+	journal->stop = 1;
+	pthread_cond_signal(&journal->flush_cond);
+	pthread_mutex_unlock(&journal->mutex);
+	pthread_join(journal->flusher, NULL);
+
+	/* The last flush has closed the sealed segments. The spare one has
+	 * no record yet and is removed. */
+	if (journal->active)
+		__msgqueue_segment_close(journal, journal->active);
+	if (journal->spare)
+	{
+		snprintf(name, sizeof name, "%016llx.seg", journal->spare->index);
+		__msgqueue_segment_close(journal, journal->spare);
+		unlinkat(journal->dirfd, name, 0);
+	}
+
+	pthread_cond_destroy(&journal->sync_cond);
+	pthread_cond_destroy(&journal->flush_cond);
+	pthread_mutex_destroy(&journal->mutex);
+	close(journal->commitfd);
+	close(journal->dirfd);
+	free(journal);
+}
+
+int msgqueue_open_journal(msgqueue_t *queue, const char *dir, size_t segment_size,
+						  long long flush_interval_ns, msgqueue_msgsize_t size,
+						  msgqueue_restore_t restore, void *context)
+{
+	struct __msgqueue_journal *journal;
+	pthread_condattr_t attr;
+	long page = sysconf(_SC_PAGESIZE);
+	long cnt = -1;
+	void *mem;
+	int ret;
+
+	if (queue->nlanes != 1)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (queue->journal)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+
+	if (posix_memalign(&mem, MARK_CACHE_LINE_SIZE, sizeof (struct __msgqueue_journal)) != 0)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+
+	journal = (struct __msgqueue_journal *)mem;
+	memset(journal, 0, sizeof (struct __msgqueue_journal));
+	journal->page_size = page > 0 ? (size_t)page : 4096;
+	journal->seg_size = (segment_size + journal->page_size - 1) & ~(journal->page_size - 1);
+	if (journal->seg_size == 0)
+		journal->seg_size = journal->page_size;
+	journal->interval_ns = flush_interval_ns > 0 ? flush_interval_ns : MSGQUEUE_JOURNAL_INTERVAL_NS;
+	journal->size = size;
+	journal->limit = ~0ULL;
+
+	journal->dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (journal->dirfd >= 0)
+	{
+		journal->commitfd = openat(journal->dirfd, "commit", O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (journal->commitfd >= 0)
+		{
+			pthread_condattr_init(&attr);
+			pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+			pthread_mutex_init(&journal->mutex, NULL);
+			pthread_cond_init(&journal->flush_cond, &attr);
+			pthread_cond_init(&journal->sync_cond, NULL);
+			pthread_condattr_destroy(&attr);
+
+			cnt = __msgqueue_journal_recover(queue, journal, restore, context);
+			if (cnt >= 0)
+			{
+				journal->prepare = 1;	/* map the next segment right away */
+				ret = pthread_create(&journal->flusher, NULL, __msgqueue_flusher, journal);
+				if (ret == 0)
+				{
+					queue->journal = journal;
+					return (int)cnt;
+				}
+
+				if (journal->active)
+					__msgqueue_segment_close(journal, journal->active);
+				errno = ret;
+			}
+
+			ret = errno;
+			pthread_cond_destroy(&journal->sync_cond);
+			pthread_cond_destroy(&journal->flush_cond);
+			pthread_mutex_destroy(&journal->mutex);
+			close(journal->commitfd);
+			errno = ret;
+		}
+
+		ret = errno;
+		close(journal->dirfd);
+		errno = ret;
+	}
+
+	free(journal);
+	return -1;
+}
+
+int msgqueue_journal_commit(msgqueue_t *queue)
+{
+	struct __msgqueue_journal *journal = queue->journal;
+	unsigned long long consumed;
+
+	if (!journal)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&queue->get_mutex);
+	consumed = journal->consumed;
+	pthread_mutex_unlock(&queue->get_mutex);
+
+	pthread_mutex_lock(&journal->mutex);
+	if (consumed > journal->committed)
+		journal->committed = consumed;
+	pthread_mutex_unlock(&journal->mutex);
+	return 0;
+}
+
+int msgqueue_journal_sync(msgqueue_t *queue)
+{
+	struct __msgqueue_journal *journal = queue->journal;
+	unsigned long long round;
+	int error;
+
+	if (!journal)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Wait for a round that starts after this call; callers arriving
+	 * while one is running share the next. */
+	pthread_mutex_lock(&journal->mutex);
+	round = journal->rounds + 1;
+	if (!journal->wanted)
+	{
+		journal->wanted = 1;
+		pthread_cond_signal(&journal->flush_cond);
+	}
+	while (journal->done < round && !journal->error)
+		pthread_cond_wait(&journal->sync_cond, &journal->mutex);
+	error = journal->error;
+	pthread_mutex_unlock(&journal->mutex);
+
+	if (error)
+	{
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+msgqueue_t *msgqueue_create(size_t maxlen, int linkoff)
+{
+	return msgqueue_create_prio(maxlen, linkoff, 1);
+}
+
+msgqueue_t *msgqueue_create_prio(size_t maxlen, int linkoff, int nprio)
+{
+	return msgqueue_create_ex(maxlen, linkoff, nprio, 0);
+}
+
+msgqueue_t *msgqueue_create_ex(size_t maxlen, int linkoff, int nprio, int flags)
+{
+	msgqueue_t *queue;
+	pthread_mutexattr_t mattr;
+	pthread_condattr_t attr;
+	size_t lists;
+	void *mem;
+	int ret;
+	int i;
+
+	if (nprio < 1)
+		nprio = 1;
+	else if (nprio > MSGQUEUE_MAX_PRIO)
+		nprio = MSGQUEUE_MAX_PRIO;
+
+	/* The put lists and then the get lists live right after the queue
+	 * structure, each array starting on its own cache line. */
+	lists = (nprio * sizeof (struct __msgqueue_list) + MARK_CACHE_LINE_SIZE - 1) &
+			~(size_t)(MARK_CACHE_LINE_SIZE - 1);
+	if (posix_memalign(&mem, MARK_CACHE_LINE_SIZE, sizeof (msgqueue_t) + 2 * lists) != 0)
+		return NULL;
+
+	queue = (msgqueue_t *)mem;
+
+	/* Adaptive mutexes spin for a while before sleeping in the kernel. */
+	pthread_mutexattr_init(&mattr);
+#ifdef PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP
+	if (flags & MSGQUEUE_LOCK_ADAPTIVE)
+		pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_ADAPTIVE_NP);
+#endif
+
+	/* Timed waits use CLOCK_MONOTONIC so wall clock jumps don't affect them. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	ret = pthread_mutex_init(&queue->get_mutex, &mattr);
+	if (ret == 0)
+	{
+		ret = pthread_mutex_init(&queue->put_mutex, &mattr);
+		if (ret == 0)
+		{
+			ret = pthread_cond_init(&queue->get_cond, &attr);
+			if (ret == 0)
+			{
+				ret = pthread_cond_init(&queue->put_cond, &attr);
+				if (ret == 0)
+				{
+					ret = pthread_mutex_init(&queue->bp_mutex, NULL);
+					if (ret == 0)
+					{
+						ret = pthread_cond_init(&queue->credit_cond, &attr);
+						if (ret == 0)
+						{
+							pthread_mutexattr_destroy(&mattr);
+							pthread_condattr_destroy(&attr);
+							queue->msg_max = maxlen;
+							queue->linkoff = linkoff;
+							queue->nlanes = nprio;
+							queue->credit_mode = !!(flags & MSGQUEUE_CREDITS);
+							queue->deadoff = 0;
+							queue->has_deadoff = 0;
+							queue->put_lists = (struct __msgqueue_list *)(queue + 1);
+							queue->get_lists = (struct __msgqueue_list *)((char *)queue->put_lists + lists);
+							for (i = 0; i < nprio; i++)
+							{
+								queue->put_lists[i].first = NULL;
+								queue->put_lists[i].tail = &queue->put_lists[i].first;
+								queue->get_lists[i].first = NULL;
+								queue->get_lists[i].tail = &queue->get_lists[i].first;
+							}
+							queue->watermark = NULL;
+							queue->watermark_ctx = NULL;
+							queue->low_mark = 0;
+							queue->high_mark = 0;
+							queue->put_mask = 0;
+							queue->wheel = NULL;
+							queue->journal = NULL;
+							queue->aging = 0;
+							queue->starve = 0;
+							queue->msg_cnt = 0;
+							queue->nonblock = 0;
+							queue->depth = 0;
+							queue->credits = maxlen;
+							queue->credit_waiters = 0;
+							queue->uncredited = 0;
+							queue->above = 0;
+							__MSGQUEUE_STAT(memset(&queue->stats, 0, sizeof (struct __msgqueue_stats)));
+							return queue;
+						}
+
+						pthread_mutex_destroy(&queue->bp_mutex);
+					}
+
+					pthread_cond_destroy(&queue->put_cond);
+				}
+
+				pthread_cond_destroy(&queue->get_cond);
+			}
+
+			pthread_mutex_destroy(&queue->put_mutex);
+		}
+
+		pthread_mutex_destroy(&queue->get_mutex);
+	}
+
+	pthread_mutexattr_destroy(&mattr);
+	pthread_condattr_destroy(&attr);
+	//errno = ret;
+	free(queue);
+	return NULL;
+}
+
+int msgqueue_set_deadline_offset(msgqueue_t *queue, int deadoff)
+{
+	/* The deadline must not share bytes with the link. */
+	if (deadoff < queue->linkoff + (int)sizeof (void *) &&
+		queue->linkoff < deadoff + (int)sizeof (unsigned long long))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&queue->put_mutex);
+	queue->deadoff = deadoff;
+	queue->has_deadoff = 1;
+	pthread_mutex_unlock(&queue->put_mutex);
+	return 0;
+}
+
+void msgqueue_set_aging(msgqueue_t *queue, size_t aging)
+{
+	pthread_mutex_lock(&queue->get_mutex);
+	queue->aging = aging;
+	queue->starve = 0;
+	pthread_mutex_unlock(&queue->get_mutex);
+}
+
+int msgqueue_get_stats(msgqueue_t *queue, struct msgqueue_stats *stats)
+{
+#ifdef MARK_QUEUE_STATS
+	struct __msgqueue_stats *s = &queue->stats;
+
+	stats->gets = __atomic_load_n(&s->gets, __ATOMIC_RELAXED);
+	stats->puts = __atomic_load_n(&s->puts, __ATOMIC_RELAXED);
+	stats->depth = stats->puts > stats->gets ? stats->puts - stats->gets : 0;
+	stats->high_water = __atomic_load_n(&s->high_water, __ATOMIC_RELAXED);
+	if (stats->high_water < stats->depth)
+		stats->high_water = stats->depth;
+	stats->blocked_puts = __atomic_load_n(&s->blocked_puts, __ATOMIC_RELAXED);
+	stats->blocked_gets = __atomic_load_n(&s->blocked_gets, __ATOMIC_RELAXED);
+	stats->empty_swaps = __atomic_load_n(&s->empty_swaps, __ATOMIC_RELAXED);
+	stats->sojourn_samples = __atomic_load_n(&s->sojourn_samples, __ATOMIC_RELAXED);
+	stats->sojourn_total_ns = __atomic_load_n(&s->sojourn_total_ns, __ATOMIC_RELAXED);
+	stats->sojourn_max_ns = __atomic_load_n(&s->sojourn_max_ns, __ATOMIC_RELAXED);
+	return 0;
+#else
+	(void)queue;
+	memset(stats, 0, sizeof (struct msgqueue_stats));
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 void msgqueue_destroy(msgqueue_t *queue)
 {
+	if (queue->journal)
+		__msgqueue_journal_close(queue->journal);
+	free(queue->wheel);
+	pthread_cond_destroy(&queue->credit_cond);
+	pthread_mutex_destroy(&queue->bp_mutex);
 	pthread_cond_destroy(&queue->put_cond);
 	pthread_cond_destroy(&queue->get_cond);
 	pthread_mutex_destroy(&queue->put_mutex);
@@ -23,6 +23,185 @@ void msgqueue_set_nonblock(msgqueue_t *queue);
 void msgqueue_set_block(msgqueue_t *queue);
 void msgqueue_destroy(msgqueue_t *queue);
 
+/* Batch variants. A chain is a list of messages where the pointer at
+ * 'linkoff' of each message points to the next message, and the last one
+ * is NULL. 'msgqueue_put_batch' appends a whole chain under one lock; in
+ * blocking mode it waits like 'msgqueue_put' and may then overshoot
+ * 'maxlen' by the chain length. 'msgqueue_get_batch' takes up to 'max'
+ * messages into 'msgs' and returns the count. 'msgqueue_get_all' returns
+ * every message ready for the consumer as a chain. Both take the get lock
+ * only once and block like 'msgqueue_get' when the queue is empty. */
+
+void msgqueue_put_batch(void *msgs, msgqueue_t *queue);
+size_t msgqueue_get_batch(msgqueue_t *queue, void **msgs, size_t max);
+void *msgqueue_get_all(msgqueue_t *queue);
+
+/* Priority variant. 'msgqueue_create_prio' creates a queue with 'nprio'
+ * lanes (at most MSGQUEUE_MAX_PRIO), lane 0 being the highest priority.
+ * All lanes share the same 'linkoff' link, the same 'maxlen' and the same
+ * put/get locks, and the swap step moves every lane at once.
+ * 'msgqueue_put_prio' queues a message on lane 'prio'; 'msgqueue_put' and
+ * the batch/timed puts use the lowest priority lane. The get functions
+ * always serve the highest non-empty lane, and 'msgqueue_get_all' returns
+ * the lanes concatenated in priority order. With 'msgqueue_set_aging'
+ * set to n > 0, after n messages served while a lower lane was waiting, the
+ * lowest non-empty lane is served once, so bulk traffic cannot starve. */
+
+#define MSGQUEUE_MAX_PRIO	32
+
+msgqueue_t *msgqueue_create_prio(size_t maxlen, int linkoff, int nprio);
+void msgqueue_put_prio(void *msg, int prio, msgqueue_t *queue);
+void msgqueue_set_aging(msgqueue_t *queue, size_t aging);
+
+/* Creation flags. MSGQUEUE_LOCK_ADAPTIVE makes the put and get mutexes
+ * spin briefly before sleeping in the kernel (PTHREAD_MUTEX_ADAPTIVE_NP on
+ * glibc, ignored elsewhere), which suits the short critical sections here.
+ * A pure spinlock is not offered because the put mutex is also used with
+ * the condition variables. 'msgqueue_create_prio' is 'msgqueue_create_ex'
+ * with no flags. */
+
+#define MSGQUEUE_LOCK_ADAPTIVE	0x1
+
+msgqueue_t *msgqueue_create_ex(size_t maxlen, int linkoff, int nprio, int flags);
+
+/* Backpressure. 'msgqueue_try_put' never waits: it returns 0 when the
+ * message is queued, or -1 with errno set to EAGAIN when the put side
+ * already holds 'maxlen' messages. Unlike 'msgqueue_put' it refuses in
+ * nonblocking mode too, so a producer that only uses it keeps at most
+ * about two times 'maxlen' messages in the queue under any overload.
+ *
+ * With MSGQUEUE_CREDITS, the queue hands out 'maxlen' credits and every
+ * put must be covered by one credit acquired beforehand; a credit comes
+ * back when its message is taken by a get. Upstream stages can thus
+ * throttle before producing a message instead of blocking after it, and
+ * the queue never holds more than 'maxlen' messages. The puts themselves
+ * never wait in this mode. 'msgqueue_acquire_credits' grants up to 'n'
+ * credits and returns the count, waiting at most 'timeout_ns' for the
+ * first one (0 tries once, a negative timeout waits without limit); it
+ * returns 0 with errno set to ETIMEDOUT on timeout, or EINVAL if the queue
+ * was created without MSGQUEUE_CREDITS. Unused credits are given back with
+ * 'msgqueue_release_credits'; the credits available never exceed 'maxlen',
+ * and releases beyond that are ignored. In this mode 'msgqueue_try_put'
+ * takes the credit itself and fails with EAGAIN when none is left.
+ *
+ * 'msgqueue_set_watermarks' calls 'callback' with MSGQUEUE_WATERMARK_HIGH
+ * when the number of queued messages rises to 'high', then with
+ * MSGQUEUE_WATERMARK_LOW once it falls back to 'low', and so on
+ * alternately. The callback runs on the putting or getting thread, outside
+ * the queue locks but serialized with other watermark callbacks, and must
+ * not put to or get from the queue. Set it before the queue is used; the
+ * queue counts messages across both sides only when a callback is set. */
+
+#define MSGQUEUE_CREDITS		0x2
+
+#define MSGQUEUE_WATERMARK_LOW	0
+#define MSGQUEUE_WATERMARK_HIGH	1
+
+typedef void (*msgqueue_watermark_t)(msgqueue_t *queue, int level, void *context);
+
+int msgqueue_try_put(void *msg, msgqueue_t *queue);
+size_t msgqueue_acquire_credits(msgqueue_t *queue, size_t n, long long timeout_ns);
+void msgqueue_release_credits(msgqueue_t *queue, size_t n);
+void msgqueue_set_watermarks(msgqueue_t *queue, size_t low, size_t high,
+							 msgqueue_watermark_t callback, void *context);
+
+/* Delayed delivery. 'msgqueue_put_at' queues 'msg' on the lowest priority
+ * lane once CLOCK_MONOTONIC reaches 'deadline_ns' (absolute, in
+ * nanoseconds). Until then the message waits in a hierarchical timing
+ * wheel (1 ms ticks, 4 levels of 64 slots) chained through its own link,
+ * so scheduling is O(1) and allocates nothing after the wheel itself,
+ * which is allocated by the first call. Due messages are moved to the put
+ * side in batches when a get swaps, and a blocked get sleeps only until
+ * the next deadline, or until a wheel level has to be cascaded. Delayed
+ * messages never block the caller and do not count against 'maxlen'
+ * before they are due; in MSGQUEUE_CREDITS mode they still need a credit.
+ * Returns 0, or -1 with errno set to ENOMEM if the wheel cannot be
+ * allocated, or EINVAL if no deadline offset was set. Messages still
+ * waiting when the queue is destroyed are not delivered.
+ *
+ * The deadline of a waiting message is kept in the message itself, in 8
+ * bytes (any alignment) at offset 'deadoff' from its head, which the
+ * caller reserves like the link at 'linkoff'. 'msgqueue_set_deadline_offset'
+ * must be called before the first 'msgqueue_put_at'; it returns 0, or -1
+ * with errno set to EINVAL if those bytes would overlap the link. */
+
+int msgqueue_set_deadline_offset(msgqueue_t *queue, int deadoff);
+int msgqueue_put_at(void *msg, long long deadline_ns, msgqueue_t *queue);
+
+/* Journal mode. 'msgqueue_open_journal' makes every put also append the
+ * message bytes to a journal in directory 'dir', so that messages put but
+ * not yet consumed survive a restart. 'size' returns the number of bytes of
+ * a message, counted from the message head; they are copied under the put
+ * lock into a memory-mapped segment file of 'segment_size' bytes (rounded
+ * up to the page size), and a new segment is started when one is full. A
+ * message must fit in a segment. A background thread makes the journal
+ * durable with one msync per segment every 'flush_interval_ns' (0 means
+ * 10 ms), so puts never wait for the disk. 'msgqueue_journal_sync' waits
+ * until everything put before the call is on disk; concurrent callers
+ * share one flush.
+ *
+ * The consumer side keeps the journal offset of the messages taken so far.
+ * 'msgqueue_journal_commit' records that every message taken by a get
+ * until now is done with; the commit is written at the next flush, and
+ * segments before it are deleted then. When the journal is opened again,
+ * the messages after the last written commit are rebuilt by 'restore' from
+ * their bytes and queued again, in order, before anything else. 'restore'
+ * must return a message for which 'size' gives 'size' again, or NULL to
+ * make the open fail with ECANCELED (messages restored so far stay queued).
+ *
+ * The journal must be opened on a new single-lane queue before it is used,
+ * and remains until 'msgqueue_destroy', which flushes it without
+ * committing. 'msgqueue_open_journal' returns the number of restored
+ * messages, or -1 with errno set (EINVAL for a queue with more lanes, EBUSY
+ * if a journal is already open). 'msgqueue_put_at' fails with EINVAL on a
+ * journaled queue. If a journal write fails, the queue carries on in
+ * memory only and 'msgqueue_journal_sync' reports the error from then on.
+ * Both commit and sync return 0, or -1 with errno set to EINVAL when the
+ * queue has no journal. Restored messages do not wait for room and may
+ * exceed 'maxlen'; in MSGQUEUE_CREDITS mode they use up the credits, and
+ * taking those restored beyond 'maxlen' gives no credit back. */
+
+typedef size_t (*msgqueue_msgsize_t)(const void *msg);
+typedef void *(*msgqueue_restore_t)(const void *data, size_t size, void *context);
+
+int msgqueue_open_journal(msgqueue_t *queue, const char *dir, size_t segment_size,
+						  long long flush_interval_ns, msgqueue_msgsize_t size,
+						  msgqueue_restore_t restore, void *context);
+int msgqueue_journal_commit(msgqueue_t *queue);
+int msgqueue_journal_sync(msgqueue_t *queue);
+
+/* Timed variants, with a relative timeout in nanoseconds measured on
+ * CLOCK_MONOTONIC; a timeout of 0 makes them try once without blocking.
+ * 'msgqueue_get_timed' returns NULL on timeout. 'msgqueue_put_timed'
+ * returns 0 on success, or -1 with errno set to ETIMEDOUT if the queue
+ * stayed full and the message was not queued. */
+
+void *msgqueue_get_timed(msgqueue_t *queue, long long timeout_ns);
+int msgqueue_put_timed(void *msg, long long timeout_ns, msgqueue_t *queue);
+
+/* Statistics, collected only when built with MARK_QUEUE_STATS defined;
+ * otherwise 'msgqueue_get_stats' returns -1 with errno set to ENOSYS.
+ * 'blocked_puts' and 'blocked_gets' count calls that had to wait on a full
+ * or empty queue, 'empty_swaps' counts swaps that found no new message.
+ * Sojourn time is sampled on one message in every 64, and only on queues
+ * with a single lane. */
+
+struct msgqueue_stats
+{
+	unsigned long long puts;
+	unsigned long long gets;
+	unsigned long long depth;
+	unsigned long long high_water;
+	unsigned long long blocked_puts;
+	unsigned long long blocked_gets;
+	unsigned long long empty_swaps;
+	unsigned long long sojourn_samples;
+	unsigned long long sojourn_total_ns;
+	unsigned long long sojourn_max_ns;
+};
+
+int msgqueue_get_stats(msgqueue_t *queue, struct msgqueue_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif